@@ -1,6 +1,7 @@
 
 CC = cc
 INSTALL = install
+PYTHON = python3
 RM = rm -f
 
 version = 1.0
@@ -21,6 +22,11 @@ ALL_CFLAGS += -std=c99
 ALL_CFLAGS += -pedantic
 ALL_CFLAGS += -fPIC
 
+# Bytes of static memory the context used by the functions that don't take
+# one lives in, so that it never allocates; 0 takes it from the heap instead
+MEMORY_SIZE = 0
+ALL_CFLAGS += -DLL_MEMORY_SIZE=$(MEMORY_SIZE)
+
 QUIET_CC = @echo CC $@;
 QUIET_LINK = @echo LINK $@;
 QUIET_INSTALL = @echo INSTALL $@;
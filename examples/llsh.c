@@ -1,16 +1,25 @@
 
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "../src/littleline.h"
 
+/* Have the line laid out again for the new width of the terminal */
+static void on_resize(int sig)
+{
+	signal(SIGWINCH, on_resize);
+	ll_terminal_resized();
+}
+
 int main(int arc, char *argv[])
 {
 	const char *line;
 
 	ll_set_key_bindings(LL_ANSI_KEY_BINDINGS);
 	ll_set_history_with_file(10, "history.txt");
+	signal(SIGWINCH, on_resize);
 
 	while ((line = ll_read(">>"))) {
 		if (strlen(line) > 0)
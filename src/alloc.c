@@ -0,0 +1,227 @@
+/* Copyright 2017 Luis Sanz <luis.sanz@gmail.com> */
+
+#include "alloc.h"
+
+#include <stdint.h>
+#include <string.h>
+
+static void *heap_malloc(void *user, size_t size);
+static void *heap_realloc(void *user, void *ptr, size_t old_size,
+		size_t size);
+static void heap_free(void *user, void *ptr, size_t size);
+static void *counter_malloc(void *user, size_t size);
+static void *counter_realloc(void *user, void *ptr, size_t old_size,
+		size_t size);
+static void counter_free(void *user, void *ptr, size_t size);
+/* Round size up to whole units of an arena */
+static size_t arena_round(size_t size);
+static void *arena_malloc(void *user, size_t size);
+static void *arena_realloc(void *user, void *ptr, size_t old_size,
+		size_t size);
+static void arena_free(void *user, void *ptr, size_t size);
+
+const struct ll_allocator ll_heap_allocator = {
+	heap_malloc, heap_realloc, heap_free, NULL
+};
+
+static void *heap_malloc(void *user, size_t size)
+{
+	return malloc(size);
+}
+
+static void *heap_realloc(void *user, void *ptr, size_t old_size,
+		size_t size)
+{
+	return realloc(ptr, size);
+}
+
+static void heap_free(void *user, void *ptr, size_t size)
+{
+	free(ptr);
+}
+
+size_t ll_grow_size(size_t allocated, size_t len)
+{
+	size_t size;
+
+	size = allocated + allocated / 100 * LL_BUF_GROWTH
+		+ allocated % 100 * LL_BUF_GROWTH / 100;
+	if (size < len)
+		size = len;
+	/* Round up to whole buckets */
+	return (size + LL_BUF_BUCKET_SIZE - 1) / LL_BUF_BUCKET_SIZE
+		* LL_BUF_BUCKET_SIZE;
+}
+
+void ll_counter_init(struct ll_counter *counter,
+		const struct ll_allocator *next)
+{
+	counter->alloc.malloc = counter_malloc;
+	counter->alloc.realloc = counter_realloc;
+	counter->alloc.free = counter_free;
+	counter->alloc.user = counter;
+	counter->next = next;
+	counter->stats.bytes = 0;
+	counter->stats.blocks = 0;
+	counter->stats.allocations = 0;
+}
+
+static void *counter_malloc(void *user, size_t size)
+{
+	struct ll_counter *counter = user;
+	void *ptr;
+
+	ptr = counter->next->malloc(counter->next->user, size);
+	++counter->stats.allocations;
+	if (ptr != NULL) {
+		counter->stats.bytes += size;
+		++counter->stats.blocks;
+	}
+	return ptr;
+}
+
+static void *counter_realloc(void *user, void *ptr, size_t old_size,
+		size_t size)
+{
+	struct ll_counter *counter = user;
+
+	ptr = counter->next->realloc(counter->next->user, ptr, old_size, size);
+	++counter->stats.allocations;
+	if (ptr != NULL)
+		counter->stats.bytes += size - old_size;
+	return ptr;
+}
+
+static void counter_free(void *user, void *ptr, size_t size)
+{
+	struct ll_counter *counter = user;
+
+	if (ptr == NULL)
+		return;
+	counter->next->free(counter->next->user, ptr, size);
+	counter->stats.bytes -= size;
+	--counter->stats.blocks;
+}
+
+void ll_arena_init(struct ll_arena *arena, void *block, size_t size)
+{
+	size_t skip = (LL_ARENA_UNIT - (uintptr_t)block % LL_ARENA_UNIT)
+		% LL_ARENA_UNIT;
+
+	arena->alloc.malloc = arena_malloc;
+	arena->alloc.realloc = arena_realloc;
+	arena->alloc.free = arena_free;
+	arena->alloc.user = arena;
+	arena->free = NULL;
+	if (size < skip + LL_ARENA_UNIT)
+		return;
+	arena->free = (struct ll_arena_chunk *)((char *)block + skip);
+	arena->free->size = (size - skip) / LL_ARENA_UNIT * LL_ARENA_UNIT;
+	arena->free->next = NULL;
+}
+
+static size_t arena_round(size_t size)
+{
+	if (size == 0)
+		return LL_ARENA_UNIT;
+	return (size + LL_ARENA_UNIT - 1) / LL_ARENA_UNIT * LL_ARENA_UNIT;
+}
+
+static void *arena_malloc(void *user, size_t size)
+{
+	struct ll_arena *arena = user;
+	struct ll_arena_chunk **it;
+	struct ll_arena_chunk *chunk;
+	struct ll_arena_chunk *rest;
+
+	size = arena_round(size);
+	/* Take the first piece big enough, leaving what is left of it free */
+	for (it = &arena->free; *it != NULL; it = &(*it)->next) {
+		chunk = *it;
+		if (chunk->size < size)
+			continue;
+		if (chunk->size == size) {
+			*it = chunk->next;
+		} else {
+			rest = (struct ll_arena_chunk *)((char *)chunk + size);
+			rest->size = chunk->size - size;
+			rest->next = chunk->next;
+			*it = rest;
+		}
+		return chunk;
+	}
+	return NULL;
+}
+
+static void *arena_realloc(void *user, void *ptr, size_t old_size,
+		size_t size)
+{
+	struct ll_arena *arena = user;
+	struct ll_arena_chunk **it;
+	struct ll_arena_chunk *next;
+	struct ll_arena_chunk *rest;
+	char *end;
+	void *moved;
+
+	if (ptr == NULL)
+		return arena_malloc(user, size);
+	old_size = arena_round(old_size);
+	size = arena_round(size);
+	end = (char *)ptr + old_size;
+	if (size <= old_size) {
+		if (size < old_size)
+			arena_free(user, end - (old_size - size),
+					old_size - size);
+		return ptr;
+	}
+	/* Grow in place if the piece right after is free and big enough */
+	for (it = &arena->free; *it != NULL && (char *)*it < end;
+			it = &(*it)->next)
+		continue;
+	next = *it;
+	if ((char *)next == end && next->size >= size - old_size) {
+		if (next->size == size - old_size) {
+			*it = next->next;
+		} else {
+			rest = (struct ll_arena_chunk *)((char *)ptr + size);
+			rest->size = next->size - (size - old_size);
+			rest->next = next->next;
+			*it = rest;
+		}
+		return ptr;
+	}
+	moved = arena_malloc(user, size);
+	if (moved == NULL)
+		return NULL;
+	memcpy(moved, ptr, old_size);
+	arena_free(user, ptr, old_size);
+	return moved;
+}
+
+static void arena_free(void *user, void *ptr, size_t size)
+{
+	struct ll_arena *arena = user;
+	struct ll_arena_chunk **it;
+	struct ll_arena_chunk *prev = NULL;
+	struct ll_arena_chunk *chunk = ptr;
+
+	if (ptr == NULL)
+		return;
+	size = arena_round(size);
+	for (it = &arena->free; *it != NULL && *it < chunk; it = &(*it)->next)
+		prev = *it;
+	/* Merge with the free pieces around it */
+	chunk->size = size;
+	chunk->next = *it;
+	if (chunk->next != NULL
+			&& (char *)chunk + chunk->size == (char *)chunk->next) {
+		chunk->size += chunk->next->size;
+		chunk->next = chunk->next->next;
+	}
+	if (prev != NULL && (char *)prev + prev->size == (char *)chunk) {
+		prev->size += chunk->size;
+		prev->next = chunk->next;
+	} else {
+		*it = chunk;
+	}
+}
@@ -0,0 +1,146 @@
+/* Copyright 2017 Luis Sanz <luis.sanz@gmail.com> */
+
+#ifndef LITTLELINE_ALLOC_H_
+#define LITTLELINE_ALLOC_H_
+
+#include <stdlib.h>
+
+/**
+ * Allocation
+ * ----------
+ *
+ * All memory is obtained through an allocator, so that it can come from
+ * somewhere else than the C library heap, and can be accounted for. Buffers
+ * grow geometrically so that building a string one character at a time takes
+ * linear time.
+ *
+ * An arena hands out memory from a single block given beforehand, so that no
+ * memory is requested from the system at all; when it runs out, allocations
+ * fail, and whatever needed the memory makes do without it.
+ */
+
+/**
+ * Minimum number of characters allocated for a buffer
+ */
+#ifndef LL_BUF_BUCKET_SIZE
+#define LL_BUF_BUCKET_SIZE 64
+#endif
+
+/**
+ * Percentage of its size that a buffer grows by at least every time it is
+ * full; 0 makes buffers grow only as much as needed
+ */
+#ifndef LL_BUF_GROWTH
+#define LL_BUF_GROWTH 50
+#endif
+
+/**
+ * A set of allocation functions
+ *
+ * All of them get ``user`` as their first argument, and the size of the
+ * memory they handle, so they can be backed by an arena
+ */
+struct ll_allocator {
+	/* Allocate size bytes; return NULL on failure */
+	void *(*malloc) (void *user, size_t size);
+	/* Resize memory of old_size bytes to size bytes; return NULL on failure,
+	 * leaving ptr as it was */
+	void *(*realloc) (void *user, void *ptr, size_t old_size, size_t size);
+	/* Release memory of size bytes */
+	void (*free) (void *user, void *ptr, size_t size);
+	/* Data for the functions above */
+	void *user;
+};
+
+/**
+ * Allocator using ``malloc()``, ``realloc()`` and ``free()``
+ */
+extern const struct ll_allocator ll_heap_allocator;
+
+/**
+ * Parts of the library that memory is accounted to
+ */
+enum {
+	/* Contexts themselves, and the name of their history file */
+	LL_ALLOC_CONTEXT,
+	/* Buffers for the line being edited and the clipboard */
+	LL_ALLOC_BUFFER,
+	/* History lines and the list holding them */
+	LL_ALLOC_HISTORY,
+	/* Key binding tables */
+	LL_ALLOC_BINDING,
+	/* Copy of what is shown on the terminal and output frames */
+	LL_ALLOC_DISPLAY,
+	/* Number of parts */
+	LL_ALLOC_KINDS
+};
+
+/**
+ * Memory usage
+ */
+struct ll_alloc_stats {
+	/* Bytes currently allocated */
+	size_t bytes;
+	/* Blocks currently allocated */
+	size_t blocks;
+	/* Calls made to allocate or resize memory so far */
+	size_t allocations;
+};
+
+/**
+ * An allocator that keeps track of the memory that goes through it, and
+ * gets it from another one
+ */
+struct ll_counter {
+	/* Functions to use, that count and call the ones in next */
+	struct ll_allocator alloc;
+	/* Allocator memory comes from */
+	const struct ll_allocator *next;
+	/* Memory in use */
+	struct ll_alloc_stats stats;
+};
+
+/**
+ * Unit in which memory is handed out by an arena; every free piece of the
+ * block holds one of these
+ */
+struct ll_arena_chunk {
+	/* Size of the piece */
+	size_t size;
+	/* Next free piece, further in the block */
+	struct ll_arena_chunk *next;
+};
+
+/**
+ * Size and alignment of the pieces handed out by an arena
+ */
+#define LL_ARENA_UNIT sizeof(struct ll_arena_chunk)
+
+/**
+ * An allocator taking memory from a block
+ */
+struct ll_arena {
+	/* Functions to use */
+	struct ll_allocator alloc;
+	/* Free pieces of the block, in order */
+	struct ll_arena_chunk *free;
+};
+
+/**
+ * Return the new size for a buffer of ``allocated`` characters that needs at
+ * least ``len``
+ */
+size_t ll_grow_size(size_t allocated, size_t len);
+/**
+ * Initialize ``counter`` to take memory from ``next``; ``&counter->alloc``
+ * can then be used as an allocator
+ */
+void ll_counter_init(struct ll_counter *counter,
+		const struct ll_allocator *next);
+/**
+ * Initialize ``arena`` to hand out the ``size`` bytes at ``block``;
+ * ``&arena->alloc`` can then be used as an allocator
+ */
+void ll_arena_init(struct ll_arena *arena, void *block, size_t size);
+
+#endif
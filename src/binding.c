@@ -3,42 +3,96 @@
 #include "binding.h"
 
 #include <stdlib.h>
+#include <string.h>
 
-static int bind_path(struct ll_fsm_state **trans, const char *str,
-		int(*func)(void));
+/* Size of a transition table */
+#define LL_FSM_TRANS_SIZE (256 * sizeof(struct ll_fsm_state *))
+
+static int bind_path(struct ll_fsm *fsm, struct ll_fsm_state **trans,
+		const char *str, int(*func)(struct ll_context *));
+static struct ll_fsm_state **new_trans(struct ll_fsm *fsm);
+static void free_trans(struct ll_fsm *fsm, struct ll_fsm_state **trans);
 
 void ll_fsm_init(struct ll_fsm *fsm, const struct ll_binding *paths)
 {
-	fsm->initial = calloc(256, sizeof(*fsm->initial));
-	while (paths->str) {
-		bind_path(fsm->initial, paths->str, paths->func);
-		++paths;
-	}
+	ll_fsm_init_alloc(fsm, paths, &ll_heap_allocator);
+}
+
+int ll_fsm_init_alloc(struct ll_fsm *fsm, const struct ll_binding *paths,
+		const struct ll_allocator *alloc)
+{
+	int retval = 0;
+
+	fsm->alloc = alloc;
+	fsm->initial = new_trans(fsm);
 	fsm->cur = fsm->initial;
+	if (fsm->initial == NULL)
+		return -1;
+	for (; paths->str; ++paths)
+		if (bind_path(fsm, fsm->initial, paths->str, paths->func) != 0)
+			retval = -1;
+	return retval;
 }
 
 void ll_fsm_deinit(struct ll_fsm *fsm)
 {
+	if (fsm->initial != NULL)
+		free_trans(fsm, fsm->initial);
+	fsm->initial = NULL;
+	fsm->cur = NULL;
 }
 
-static int bind_path(struct ll_fsm_state **trans, const char *str,
-		int(*func)(void))
+static struct ll_fsm_state **new_trans(struct ll_fsm *fsm)
 {
-	struct ll_fsm_state *next = trans[*str];
+	struct ll_fsm_state **trans;
+
+	trans = fsm->alloc->malloc(fsm->alloc->user, LL_FSM_TRANS_SIZE);
+	if (trans != NULL)
+		memset(trans, 0, LL_FSM_TRANS_SIZE);
+	return trans;
+}
+
+static void free_trans(struct ll_fsm *fsm, struct ll_fsm_state **trans)
+{
+	int i;
+
+	for (i = 0; i < 256; ++i) {
+		if (trans[i] == NULL)
+			continue;
+		if (trans[i]->type == LL_FSM_INNER_STATE)
+			free_trans(fsm, trans[i]->data.trans);
+		fsm->alloc->free(fsm->alloc->user, trans[i], sizeof(*trans[i]));
+	}
+	fsm->alloc->free(fsm->alloc->user, trans, LL_FSM_TRANS_SIZE);
+}
+
+static int bind_path(struct ll_fsm *fsm, struct ll_fsm_state **trans,
+		const char *str, int(*func)(struct ll_context *))
+{
+	unsigned char c = *str;
+	struct ll_fsm_state *next = trans[c];
 	if (str[1]) {
 		if (next == NULL) {
-			next = malloc(sizeof(*next));
-			trans[*str] = next;
+			next = fsm->alloc->malloc(fsm->alloc->user, sizeof(*next));
+			if (next == NULL)
+				return -1;
 			next->type = LL_FSM_INNER_STATE;
-			next->data.trans = calloc(256, sizeof(*next->data.trans));
+			next->data.trans = new_trans(fsm);
+			if (next->data.trans == NULL) {
+				fsm->alloc->free(fsm->alloc->user, next, sizeof(*next));
+				return -1;
+			}
+			trans[c] = next;
 		} else if (next->type == LL_FSM_FINAL_STATE) {
 			return -1;
 		}
-		return bind_path(next->data.trans, str + 1, func);
+		return bind_path(fsm, next->data.trans, str + 1, func);
 	} else {
 		if (next == NULL) {
-			next = malloc(sizeof(*next));
-			trans[*str] = next;
+			next = fsm->alloc->malloc(fsm->alloc->user, sizeof(*next));
+			if (next == NULL)
+				return -1;
+			trans[c] = next;
 			next->type = LL_FSM_FINAL_STATE;
 		} else if (next->type == LL_FSM_INNER_STATE) {
 			return -1;
@@ -48,9 +102,14 @@ static int bind_path(struct ll_fsm_state **trans, const char *str,
 	}
 }
 
-int ll_fsm_feed(struct ll_fsm *fsm, unsigned char token, int(**func)(void))
+int ll_fsm_feed(struct ll_fsm *fsm, unsigned char token,
+		int(**func)(struct ll_context *))
 {
-	struct ll_fsm_state *next = fsm->cur[token];
+	struct ll_fsm_state *next;
+
+	if (fsm->cur == NULL)
+		return LL_FSM_BAD_STATE;
+	next = fsm->cur[token];
 	if (next == NULL) {
 		fsm->cur = fsm->initial;
 		return LL_FSM_BAD_STATE;
@@ -64,3 +123,8 @@ int ll_fsm_feed(struct ll_fsm *fsm, unsigned char token, int(**func)(void))
 	}
 	return LL_FSM_BAD_STATE;
 }
+
+void ll_fsm_reset(struct ll_fsm *fsm)
+{
+	fsm->cur = fsm->initial;
+}
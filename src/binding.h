@@ -3,6 +3,8 @@
 #ifndef LITTLELINE_FSM_H_
 #define LITTLELINE_FSM_H_
 
+#include "alloc.h"
+
 /**
  * Finite State Machine
  * --------------------
@@ -11,6 +13,9 @@
  * library to parse key sequences and determine the action that must be taken.
  */
 
+/* Commands bound to key sequences take the context they operate on */
+struct ll_context;
+
 /** 
  * Type of states in the transition table 
  *
@@ -45,7 +50,7 @@ struct ll_fsm_state {
 		/* For intermediate states, a table with all possible transitions */
 		struct ll_fsm_state **trans;
 		/* For final states data that determines what it actually is */
-		int(*func)(void);
+		int(*func)(struct ll_context *);
 	} data;
 };
 
@@ -57,6 +62,8 @@ struct ll_fsm {
 	struct ll_fsm_state **initial;
 	/* Pointer to iterate the machine */
 	struct ll_fsm_state **cur;
+	/* Where the memory for the states comes from */
+	const struct ll_allocator *alloc;
 };
 
 /** 
@@ -66,13 +73,19 @@ struct ll_binding {
 	/* A string to be recognized */
 	const char *str;
 	/* Data that identifies the final state */
-	int(*func)(void);
+	int(*func)(struct ll_context *);
 };
 
 /**
  * Initialize a limited finite state machine from the given ``paths``
  */
 void ll_fsm_init(struct ll_fsm *fsm, const struct ll_binding *paths);
+/**
+ * Same as ``ll_fsm_init()``, taking memory from ``alloc``; return -1 if
+ * there was not enough for every path
+ */
+int ll_fsm_init_alloc(struct ll_fsm *fsm, const struct ll_binding *paths,
+		const struct ll_allocator *alloc);
 /**
  * Destroy
  */
@@ -84,7 +97,13 @@ void ll_fsm_deinit(struct ll_fsm *fsm);
  * intermediate, reset the internal pointer to the initial state transition
  * table so the next call will start from scratch 
  */
-int ll_fsm_feed(struct ll_fsm *fsm, unsigned char token, int(**func)(void));
+int ll_fsm_feed(struct ll_fsm *fsm, unsigned char token,
+		int(**func)(struct ll_context *));
+/**
+ * Forget about the tokens fed so far; the next call to ``ll_fsm_feed()`` will
+ * start from the initial state
+ */
+void ll_fsm_reset(struct ll_fsm *fsm);
 
 #endif
 
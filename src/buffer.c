@@ -2,39 +2,77 @@
 
 #include "buffer.h"
 
+/* Make room for at least len characters; return -1 if there is no memory */
+static int buf_grow(struct ll_buf *buf, size_t len);
+/* Make room for len more characters after the first used ones, and return
+ * how many of them fit */
+static size_t buf_fit(struct ll_buf *buf, size_t used, size_t len);
+
 void ll_buf_init(struct ll_buf *buf)
 {
-	buf->str = calloc(LL_BUF_BUCKET_SIZE, 1);
-	buf->allocated = LL_BUF_BUCKET_SIZE;
+	ll_buf_init_alloc(buf, &ll_heap_allocator);
+}
+
+void ll_buf_init_alloc(struct ll_buf *buf, const struct ll_allocator *alloc)
+{
+	buf->alloc = alloc;
+	buf->str = alloc->malloc(alloc->user, LL_BUF_BUCKET_SIZE);
+	buf->allocated = buf->str != NULL ? LL_BUF_BUCKET_SIZE : 0;
 	buf->len = 0;
+	if (buf->str != NULL)
+		buf->str[0] = 0;
 }
 
 void ll_buf_deinit(struct ll_buf *buf)
 {
-	free(buf->str);
+	buf->alloc->free(buf->alloc->user, buf->str, buf->allocated);
 }
 
-void ll_buf_grow(struct ll_buf *buf, size_t len)
+static int buf_grow(struct ll_buf *buf, size_t len)
 {
-	if (buf->allocated < len) {
-		do
-			buf->allocated += LL_BUF_BUCKET_SIZE;
-		while(buf->allocated < len);
-		buf->str = realloc(buf->str, buf->allocated);
-	}
+	size_t allocated;
+	char *str;
+
+	if (buf->allocated >= len)
+		return 0;
+	allocated = ll_grow_size(buf->allocated, len);
+	if (buf->str == NULL)
+		str = buf->alloc->malloc(buf->alloc->user, allocated);
+	else
+		str = buf->alloc->realloc(buf->alloc->user, buf->str,
+				buf->allocated, allocated);
+	if (str == NULL)
+		return -1;
+	buf->str = str;
+	buf->allocated = allocated;
+	return 0;
+}
+
+static size_t buf_fit(struct ll_buf *buf, size_t used, size_t len)
+{
+	if (buf_grow(buf, used + len + 1) == 0)
+		return len;
+	if (buf->allocated <= used + 1)
+		return 0;
+	return buf->allocated - used - 1;
 }
 
 void ll_buf_assign(struct ll_buf *buf, const void *str, size_t len)
 {
-	ll_buf_grow(buf, len + 1);
-	memcpy(buf->str, str, len + 1);
+	len = buf_fit(buf, 0, len);
+	if (buf->str == NULL)
+		return;
+	memcpy(buf->str, str, len);
+	buf->str[len] = 0;
 	buf->len = len;
 }
 
 void ll_buf_insert(struct ll_buf *buf, size_t where, const void *str, size_t len)
 {
 	assert(where <= buf->len);
-	ll_buf_grow(buf, buf->len + len + 1);
+	len = buf_fit(buf, buf->len, len);
+	if (len == 0)
+		return;
 	memmove(buf->str + (where + len), buf->str + where, buf->len - where + 1);
 	memcpy(buf->str + where, str, len);
 	buf->len += len;
@@ -59,10 +97,17 @@ void ll_buf_replace(struct ll_buf *buf, size_t where, const void *str, size_t le
 void ll_buf_erase(struct ll_buf *buf, size_t where, size_t len)
 {
 	assert(where + len <= buf->len);
-	memmove(buf->str + where, buf->str + (where + len), buf->len - where + len + 1);
+	memmove(buf->str + where, buf->str + (where + len), buf->len - where - len + 1);
 	buf->len -= len;
 }
 
+void ll_buf_truncate(struct ll_buf *buf, size_t len)
+{
+	assert(len <= buf->len);
+	buf->str[len] = 0;
+	buf->len = len;
+}
+
 void ll_buf_insert_char(struct ll_buf *buf, size_t where, char c)
 {
 	ll_buf_insert(buf, where, &c, 1);
@@ -7,6 +7,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "alloc.h"
+
 /**
  * Buffer
  * ------
@@ -16,11 +18,6 @@
  * a place where they have to be modified.
  */
 
-/**
- * Number of characters added every time a buffer has to grow
- */
-#define LL_BUF_BUCKET_SIZE 64
-
 /**
  * A helper to build text strings 
  */
@@ -31,12 +28,19 @@ struct ll_buf {
 	size_t allocated;
 	/* Number of characters currently used */
 	size_t len;
+	/* Where the memory for the string comes from */
+	const struct ll_allocator *alloc;
 };
 
 /**
  * Initialize buffer 
  */
 void ll_buf_init(struct ll_buf *buf);
+/**
+ * Initialize buffer, taking memory from ``alloc``; if there is not enough,
+ * text that would make the buffer grow is cut down to what fits
+ */
+void ll_buf_init_alloc(struct ll_buf *buf, const struct ll_allocator *alloc);
 /**
  * Destroy buffer
  */
@@ -66,6 +70,10 @@ void ll_buf_replace(struct ll_buf *buf, size_t where, const void *str, size_t le
  * Erase ``len`` characters of ``buf`` starting at ``where``
  */
 void ll_buf_erase(struct ll_buf *buf, size_t where, size_t len);
+/**
+ * Erase all characters of ``buf`` from ``len`` on
+ */
+void ll_buf_truncate(struct ll_buf *buf, size_t len);
 /**
  * Insert character; same as ``ll_buf_insert(buf, where, &c, 1)``
  */
@@ -0,0 +1,924 @@
+/* Copyright 2017 Luis Sanz <luis.sanz@gmail.com> */
+
+#include "display.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "scan.h"
+#include "width_table.h"
+
+/* Sent before and after the marked part of a line */
+#define LL_MARK_ON "\x1B[7m"
+#define LL_MARK_OFF "\x1B[27m"
+/* Same, when it is dimmed */
+#define LL_DIM_ON "\x1B[2m"
+#define LL_DIM_OFF "\x1B[22m"
+/* Bytes compared at once when looking for what changed in a line */
+#define LL_COMPARE_BLOCK 64
+
+/* A line given in two pieces, e.g. the text at both sides of the gap of a
+ * gap buffer */
+struct split {
+	const char *line;
+	size_t line_len;
+	const char *tail;
+	size_t tail_len;
+};
+
+
+/* Initialize formatted line */
+static void layout_init(struct ll_layout *lay,
+		const struct ll_allocator *alloc);
+/* Destroy formatted line */
+static void layout_deinit(struct ll_layout *lay);
+/* Remove everything from the formatted line */
+static void layout_clear(struct ll_layout *lay);
+/* Make room for n more cells; return -1 if there is no memory */
+static int layout_reserve(struct ll_layout *lay, size_t n);
+/* Start a new cell for byte src at position pos */
+static void layout_cell(struct ll_layout *lay, size_t src, size_t pos);
+/* Add a cell for each of the first len plain ASCII characters from byte src
+ * on, starting at position pos, and return how many there was room for */
+static size_t layout_ascii(struct ll_layout *lay, size_t src, size_t pos,
+		size_t len);
+/* Return the index of the last cell starting at or before byte src */
+static size_t layout_find(const struct ll_layout *lay, size_t src);
+/* Return the number of columns taken by code point cp */
+static size_t code_point_width(unsigned long cp);
+/* Return the number of bytes of the character at str, of which at most len
+ * are available, and its width; if verbatim, it's printed as it is */
+static size_t char_info(const char *str, size_t len, int verbatim,
+		size_t *width);
+/* Return the change of attributes that starts the marked characters if on is
+ * set, or else the one that ends them, dimmed if dim is set */
+static const char *mark_seq(int dim, int on);
+/* Add to the text of lay the change of attributes that starts its marked
+ * characters if on is set, or else the one that ends them */
+static void layout_mark(struct ll_layout *lay, int on);
+/* Format the source of lay from byte src on, starting at position pos; if
+ * there is no memory for all of it, the rest is left out */
+static void layout_format(struct ll_layout *lay, size_t cols, size_t src,
+		size_t pos);
+/* Return first, or the first byte of the source of lay before it whose
+ * marking changes if mark_begin, mark_end and mark_dim are the new marks */
+static size_t mark_change(const struct ll_layout *lay, size_t first,
+		size_t mark_begin, size_t mark_end, int mark_dim);
+/* Return the byte of the source of lay after the last one whose marking
+ * changes with the new marks, or -1 if the marking of the last one does */
+static size_t mark_change_end(const struct ll_layout *lay,
+		size_t mark_begin, size_t mark_end, int mark_dim);
+/* Length of the common prefix of a and b */
+static size_t common_prefix(const char *a, size_t alen, const char *b,
+		size_t blen);
+/* Move the terminal cursor to position pos */
+static void move_to(struct ll_display *disp, size_t pos);
+/* Write len bytes of str to the terminal; return how many could not be */
+static size_t write_all(struct ll_display *disp, const char *str, size_t len);
+/* Print all cells from the one whose index is first on */
+static void redraw(struct ll_display *disp, size_t first, size_t old_end);
+/* Print the cells from the one whose index is first to before last, leaving
+ * the ones after them as they are */
+static void redraw_range(struct ll_display *disp, size_t first, size_t last);
+/* Check the width of the terminal, unless it was checked since the display
+ * was reset and it has not been resized since; if it changed, draw
+ * everything again and return 1 */
+static int check_width(struct ll_display *disp);
+/* Put a CSI sequence with a numeric argument into the frame */
+static void put_csi(struct ll_display *disp, size_t n, char cmd);
+/* Return the byte of s whose index is i, or 0 past its end */
+static char split_at(const struct split *s, size_t i);
+/* Same as char_info() for the character of s at index i, of which at most
+ * len bytes are available */
+static size_t split_char(const struct split *s, size_t i, size_t len,
+		size_t *width);
+/* Add to buf the bytes of s from begin to before end */
+static void split_append(struct ll_buf *buf, const struct split *s,
+		size_t begin, size_t end);
+/* Put in the view the part of line around cursor that fits in one row, and
+ * return the index of the cursor in it */
+static size_t scroll_view(struct ll_display *disp, const char *prompt,
+		const struct split *line, size_t cursor);
+/* Show prompt followed by line with the cursor at index cursor of it, and
+ * the bytes of line from mark_begin to mark_end marked, dimmed if mark_dim
+ * is set */
+static void update(struct ll_display *disp, const char *prompt,
+		const char *line, size_t line_len, const char *tail,
+		size_t tail_len, size_t cursor, size_t mark_begin,
+		size_t mark_end, int mark_dim);
+
+static void layout_init(struct ll_layout *lay,
+		const struct ll_allocator *alloc)
+{
+	lay->alloc = alloc;
+	ll_buf_init_alloc(&lay->src, alloc);
+	ll_buf_init_alloc(&lay->text, alloc);
+	lay->cells = alloc->malloc(alloc->user, sizeof(*lay->cells));
+	lay->allocated = lay->cells != NULL;
+	layout_clear(lay);
+}
+
+static void layout_deinit(struct ll_layout *lay)
+{
+	ll_buf_deinit(&lay->src);
+	ll_buf_deinit(&lay->text);
+	lay->alloc->free(lay->alloc->user, lay->cells,
+			lay->allocated * sizeof(*lay->cells));
+}
+
+static void layout_clear(struct ll_layout *lay)
+{
+	ll_buf_truncate(&lay->src, 0);
+	ll_buf_truncate(&lay->text, 0);
+	lay->prompt = 0;
+	lay->len = 0;
+	lay->mark_begin = 0;
+	lay->mark_end = 0;
+	lay->mark_dim = 0;
+	layout_cell(lay, 0, 0);
+}
+
+static int layout_reserve(struct ll_layout *lay, size_t n)
+{
+	size_t allocated = lay->allocated;
+	struct ll_cell *cells;
+
+	if (lay->len + n > allocated) {
+		do
+			allocated *= 2;
+		while (lay->len + n > allocated);
+		cells = lay->alloc->realloc(lay->alloc->user, lay->cells,
+				lay->allocated * sizeof(*lay->cells),
+				allocated * sizeof(*lay->cells));
+		if (cells == NULL)
+			return -1;
+		lay->cells = cells;
+		lay->allocated = allocated;
+	}
+	return 0;
+}
+
+static void layout_cell(struct ll_layout *lay, size_t src, size_t pos)
+{
+	layout_reserve(lay, 1);
+	lay->cells[lay->len].src = src;
+	lay->cells[lay->len].out = lay->text.len;
+	lay->cells[lay->len].pos = pos;
+	++lay->len;
+}
+
+static size_t layout_ascii(struct ll_layout *lay, size_t src, size_t pos,
+		size_t len)
+{
+	struct ll_cell *cell;
+	size_t out = lay->text.len;
+	size_t i;
+
+	/* Always leave room for the cell that ends the line */
+	if (layout_reserve(lay, len + 1) != 0)
+		len = lay->allocated - lay->len - 1;
+	ll_buf_append(&lay->text, lay->src.str + src, len);
+	len = lay->text.len - out;
+	cell = lay->cells + lay->len;
+	for (i = 0; i < len; ++i) {
+		cell[i].src = src + i;
+		cell[i].out = out + i;
+		cell[i].pos = pos + i;
+	}
+	lay->len += len;
+	return len;
+}
+
+static size_t layout_find(const struct ll_layout *lay, size_t src)
+{
+	size_t lo = 0;
+	size_t hi = lay->len;
+	size_t mid;
+
+	while (hi - lo > 1) {
+		mid = lo + (hi - lo) / 2;
+		if (lay->cells[mid].src <= src)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static size_t code_point_width(unsigned long cp)
+{
+	const unsigned char *block;
+
+	if (cp >= LL_WIDTH_MAX_CODE_POINT)
+		return 1;
+	block = ll_width_blocks[ll_width_index[cp / LL_WIDTH_BLOCK_SIZE]];
+	cp %= LL_WIDTH_BLOCK_SIZE;
+	return (block[cp / 4] >> (2 * (cp % 4))) & 3;
+}
+
+static size_t char_info(const char *str, size_t len, int verbatim,
+		size_t *width)
+{
+	unsigned char c = *str;
+	size_t size;
+
+	if ((c & 0x80) == 0 || (c & 0xC0) == 0x80)
+		size = 1;
+	else if ((c & 0xE0) == 0xC0)
+		size = 2;
+	else if ((c & 0xF0) == 0xE0)
+		size = 3;
+	else if ((c & 0xF8) == 0xF0)
+		size = 4;
+	else if ((c & 0xFC) == 0xF8)
+		size = 5;
+	else
+		size = 1;
+	if (verbatim) {
+		/* Escape sequences take no room on the terminal */
+		if (c == 0x1B && len > 1 && str[1] == '[') {
+			size = 2;
+			while (size < len && (str[size] < 0x40 || str[size] > 0x7E))
+				++size;
+			if (size < len)
+				++size;
+		} else if (size > len) {
+			size = 1;
+		}
+		*width = (c < 32 || c == 0x7F) ? 0 : 1;
+		return size;
+	}
+	/* A truncated utf-8 sequence can't be printed */
+	if (size > len)
+		return 0;
+	if (c < 32)
+		*width = 2;
+	else if ((c & 0x80) == 0)
+		*width = 1;
+	else if (size == 2)
+		*width = code_point_width((c & 0x1Ful) << 6 | (str[1] & 0x3F));
+	else if (size == 3)
+		*width = code_point_width((c & 0x0Ful) << 12
+				| (str[1] & 0x3F) << 6 | (str[2] & 0x3F));
+	else if (size == 4)
+		*width = code_point_width((c & 0x07ul) << 18
+				| (str[1] & 0x3F) << 12 | (str[2] & 0x3F) << 6
+				| (str[3] & 0x3F));
+	else if (size == 5)
+		*width = 1;
+	else
+		*width = 4;
+	return size;
+}
+
+static const char *mark_seq(int dim, int on)
+{
+	if (dim)
+		return on ? LL_DIM_ON : LL_DIM_OFF;
+	return on ? LL_MARK_ON : LL_MARK_OFF;
+}
+
+static void layout_mark(struct ll_layout *lay, int on)
+{
+	const char *seq = mark_seq(lay->mark_dim, on);
+
+	ll_buf_append(&lay->text, seq, strlen(seq));
+}
+
+static void layout_format(struct ll_layout *lay, size_t cols, size_t src,
+		size_t pos)
+{
+	static const char hex[] = "0123456789ABCDEF";
+	const char *str = lay->src.str;
+	size_t len = lay->src.len;
+	int marked = lay->mark_begin < lay->mark_end;
+	size_t i;
+	unsigned char c;
+	size_t size;
+	size_t width;
+	char seq[4];
+	const char *shown;
+	size_t shown_len;
+	size_t mark;
+	size_t stop;
+	size_t out;
+	size_t pad;
+
+	for (i = src; i < len; i += size) {
+		c = str[i];
+		/* Always leave room for the cell that ends the line */
+		if (layout_reserve(lay, 2) != 0)
+			break;
+		mark = lay->text.len;
+		pad = 0;
+		if (i < lay->prompt) {
+			/* The prompt is printed as it is, escape sequences and
+			 * all */
+			size = char_info(str + i, lay->prompt - i, 1, &width);
+			shown = str + i;
+			shown_len = size;
+		} else {
+			/* Marked characters are set apart by a change of
+			 * attributes, which is repeated when formatting starts
+			 * among them */
+			stop = len;
+			if (marked && i < lay->mark_begin) {
+				stop = lay->mark_begin;
+			} else if (marked && i < lay->mark_end) {
+				stop = lay->mark_end;
+				if (i == lay->mark_begin || i == src)
+					layout_mark(lay, 1);
+			} else if (marked && i == lay->mark_end) {
+				layout_mark(lay, 0);
+			}
+			/* Copy runs of plain ASCII in one go */
+			size = ll_scan_ascii(str + i, stop - i);
+			if (size > 0) {
+				out = lay->len;
+				width = layout_ascii(lay, i, pos, size);
+				pos += width;
+				if (width > 0)
+					lay->cells[out].out = mark;
+				else
+					ll_buf_truncate(&lay->text, mark);
+				if (width < size) {
+					i += width;
+					break;
+				}
+				continue;
+			}
+			size = char_info(str + i, len - i, 0, &width);
+			if (size == 0) {
+				ll_buf_truncate(&lay->text, mark);
+				break;
+			}
+			if (c < 32) {
+				/* Handle special characters */
+				seq[0] = '^';
+				seq[1] = c + 64;
+				shown = seq;
+				shown_len = 2;
+			} else if (size > 1 || (c & 0x80) == 0) {
+				/* Handle plain ASCII and utf-8 sequences */
+				shown = str + i;
+				shown_len = size;
+				/* Wide characters that do not fit at the end of a row
+				 * go to the next one, clearing the column they skip */
+				if (cols > 1 && width == 2 && pos % cols == cols - 1)
+					pad = 1;
+			} else {
+				/* Handle bad utf-8 sequence */
+				seq[0] = '\\';
+				seq[1] = 'x';
+				seq[2] = hex[c >> 4];
+				seq[3] = hex[c & 0xF];
+				shown = seq;
+				shown_len = 4;
+			}
+		}
+		out = lay->text.len;
+		layout_cell(lay, i, pos);
+		lay->cells[lay->len - 1].out = mark;
+		ll_buf_append(&lay->text, " ", pad);
+		ll_buf_append(&lay->text, shown, shown_len);
+		if (lay->text.len - out < pad + shown_len) {
+			/* No room for the character: leave it out */
+			ll_buf_truncate(&lay->text, mark);
+			--lay->len;
+			break;
+		}
+		pos += pad + width;
+	}
+	/* The last cell marks the end of the line, and of the marked
+	 * characters if they go on up to it */
+	layout_cell(lay, i, pos);
+	if (marked && i > lay->mark_begin && i <= lay->mark_end)
+		layout_mark(lay, 0);
+}
+
+static size_t mark_change(const struct ll_layout *lay, size_t first,
+		size_t mark_begin, size_t mark_end, int mark_dim)
+{
+	size_t old_begin = lay->mark_begin;
+	size_t old_end = lay->mark_end;
+
+	/* No mark is taken as an empty one past the end */
+	if (old_begin == old_end)
+		old_begin = old_end = (size_t)-1;
+	if (mark_begin == mark_end)
+		mark_begin = mark_end = (size_t)-1;
+	/* A mark that looks different changes all of it */
+	if (mark_dim != lay->mark_dim && mark_begin == old_begin) {
+		if (mark_begin < first)
+			first = mark_begin;
+	} else if (mark_begin != old_begin) {
+		if (mark_begin < first)
+			first = mark_begin;
+		if (old_begin < first)
+			first = old_begin;
+	}
+	if (mark_end != old_end) {
+		if (mark_end < first)
+			first = mark_end;
+		if (old_end < first)
+			first = old_end;
+	}
+	return first;
+}
+
+static size_t mark_change_end(const struct ll_layout *lay,
+		size_t mark_begin, size_t mark_end, int mark_dim)
+{
+	size_t old_begin = lay->mark_begin;
+	size_t old_end = lay->mark_end;
+
+	/* Only a mark that moves one of its ends, looking the same, leaves the
+	 * marking of the bytes past that end as it was */
+	if (old_begin == old_end || mark_begin == mark_end
+			|| mark_dim != lay->mark_dim)
+		return (size_t)-1;
+	if (mark_end == old_end)
+		return mark_begin > old_begin ? mark_begin : old_begin;
+	if (mark_begin == old_begin)
+		return mark_end > old_end ? mark_end : old_end;
+	return (size_t)-1;
+}
+
+static size_t common_prefix(const char *a, size_t alen, const char *b,
+		size_t blen)
+{
+	size_t i;
+	size_t len = alen < blen ? alen : blen;
+
+	/* Skip whole blocks that are the same first, which memcmp() does much
+	 * faster than a loop going a byte at a time */
+	for (i = 0; i + LL_COMPARE_BLOCK <= len
+			&& memcmp(a + i, b + i, LL_COMPARE_BLOCK) == 0;
+			i += LL_COMPARE_BLOCK)
+		continue;
+	for (; i < len; ++i)
+		if (a[i] != b[i])
+			break;
+	return i;
+}
+
+static void put_csi(struct ll_display *disp, size_t n, char cmd)
+{
+	char seq[32];
+
+	sprintf(seq, "\x1B[%lu%c", (unsigned long)n, cmd);
+	ll_display_put(disp, seq, strlen(seq));
+}
+
+static void move_to(struct ll_display *disp, size_t pos)
+{
+	size_t from_row = 0;
+	size_t from_col = disp->cursor;
+	size_t to_row = 0;
+	size_t to_col = pos;
+
+	if (disp->cols > 0) {
+		from_row = disp->cursor / disp->cols;
+		from_col = disp->cursor % disp->cols;
+		to_row = pos / disp->cols;
+		to_col = pos % disp->cols;
+	}
+	if (to_row < from_row)
+		put_csi(disp, from_row - to_row, 'A');
+	else if (to_row > from_row)
+		put_csi(disp, to_row - from_row, 'B');
+	if (to_col == 0 && from_col > 1)
+		ll_display_putc(disp, '\r');
+	else if (to_col + 1 == from_col)
+		ll_display_putc(disp, '\b');
+	else if (to_col < from_col)
+		put_csi(disp, from_col - to_col, 'D');
+	else if (to_col > from_col)
+		put_csi(disp, to_col - from_col, 'C');
+	disp->cursor = pos;
+}
+
+static void redraw(struct ll_display *disp, size_t first, size_t old_end)
+{
+	struct ll_layout *lay = &disp->shown;
+	const struct ll_cell *start = &lay->cells[first];
+	const struct ll_cell *end = &lay->cells[lay->len - 1];
+
+	move_to(disp, start->pos);
+	if (start->out < lay->text.len) {
+		ll_display_put(disp, lay->text.str + start->out,
+				lay->text.len - start->out);
+		disp->cursor = end->pos;
+		/* A terminal leaves the cursor at the end of a row after filling
+		 * it; go explicitly to the next one, unless nothing printable was
+		 * written and the cursor is already there */
+		if (disp->cols > 0 && end->pos > start->pos
+				&& end->pos % disp->cols == 0)
+			ll_display_put(disp, "\r\n", 2);
+	}
+	/* If the old line was longer, erase what remains of it */
+	if (old_end > end->pos) {
+		move_to(disp, end->pos);
+		if (disp->cols > 0 && (old_end - 1) / disp->cols > end->pos / disp->cols)
+			ll_display_put(disp, "\x1B[J", 3);
+		else
+			ll_display_put(disp, "\x1B[K", 3);
+	}
+}
+
+static void redraw_range(struct ll_display *disp, size_t first, size_t last)
+{
+	struct ll_layout *lay = &disp->shown;
+	const struct ll_cell *start = &lay->cells[first];
+	const struct ll_cell *end = &lay->cells[last];
+	const char *off = mark_seq(lay->mark_dim, 0);
+
+	move_to(disp, start->pos);
+	ll_display_put(disp, lay->text.str + start->out, end->out - start->out);
+	/* The marked characters the range ends among are left as they were;
+	 * end them here instead */
+	if (end->src > lay->mark_begin && end->src <= lay->mark_end)
+		ll_display_put(disp, off, strlen(off));
+	disp->cursor = end->pos;
+	if (disp->cols > 0 && end->pos > start->pos
+			&& end->pos % disp->cols == 0)
+		ll_display_put(disp, "\r\n", 2);
+}
+
+static int check_width(struct ll_display *disp)
+{
+	struct winsize ws;
+	struct ll_layout *lay = &disp->shown;
+
+	if (disp->width_checked)
+		return 0;
+	disp->width_checked = 1;
+	if (ioctl(disp->fd, TIOCGWINSZ, &ws) != 0 || ws.ws_col == 0
+			|| ws.ws_col == disp->cols)
+		return 0;
+	if (lay->len == 1) {
+		disp->cols = ws.ws_col;
+		return 1;
+	}
+	/* Go back to the start of the prompt as it was laid out, and print the
+	 * whole line again with the new width */
+	move_to(disp, 0);
+	ll_display_put(disp, "\x1B[J", 3);
+	disp->cols = ws.ws_col;
+	lay->len = 1;
+	ll_buf_truncate(&lay->text, 0);
+	layout_format(lay, disp->cols, 0, 0);
+	redraw(disp, 0, 0);
+	return 1;
+}
+
+static char split_at(const struct split *s, size_t i)
+{
+	if (i < s->line_len)
+		return s->line[i];
+	if (i - s->line_len < s->tail_len)
+		return s->tail[i - s->line_len];
+	return 0;
+}
+
+static size_t split_char(const struct split *s, size_t i, size_t len,
+		size_t *width)
+{
+	char bytes[5];
+	size_t n;
+
+	/* No character takes more bytes than these */
+	for (n = 0; n < len && n < sizeof(bytes); ++n)
+		bytes[n] = split_at(s, i + n);
+	return char_info(bytes, n, 0, width);
+}
+
+static void split_append(struct ll_buf *buf, const struct split *s,
+		size_t begin, size_t end)
+{
+	if (begin < s->line_len)
+		ll_buf_append(buf, s->line + begin,
+				(end < s->line_len ? end : s->line_len) - begin);
+	if (end > s->line_len) {
+		begin = begin > s->line_len ? begin - s->line_len : 0;
+		ll_buf_append(buf, s->tail + begin, end - s->line_len - begin);
+	}
+}
+
+static size_t scroll_view(struct ll_display *disp, const char *prompt,
+		const struct split *line, size_t cursor)
+{
+	size_t prompt_len = strlen(prompt);
+	size_t avail;
+	size_t room;
+	size_t used;
+	size_t width;
+	size_t size;
+	size_t left;
+	size_t mark;
+	size_t len;
+	size_t i;
+	size_t j;
+
+	/* Leave the last column alone, so the terminal never wraps */
+	for (used = 0, i = 0; i < prompt_len; i += size) {
+		size = char_info(prompt + i, prompt_len - i, 1, &width);
+		used += width;
+	}
+	avail = disp->cols > used + 4 ? disp->cols - 1 - used : 3;
+	/* Go back from the cursor as far as the row allows, leaving room for
+	 * the markers */
+	if (cursor < disp->view_begin)
+		disp->view_begin = cursor;
+	used = 0;
+	for (i = cursor; i > disp->view_begin; i = j) {
+		j = i - 1;
+		while (j > disp->view_begin
+				&& (split_at(line, j) & 0xC0) == 0x80)
+			--j;
+		if (split_char(line, j, i - j, &width) == 0)
+			width = 0;
+		if (used + width > avail - 2)
+			break;
+		used += width;
+	}
+	disp->view_begin = i;
+	/* Then go forward from there as far as the row allows */
+	left = disp->view_begin > 0;
+	room = avail - left;
+	mark = (size_t)-1;
+	used = 0;
+	for (i = disp->view_begin; split_at(line, i); i += size) {
+		for (len = 1; len < 5 && split_at(line, i + len); ++len)
+			continue;
+		size = split_char(line, i, len, &width);
+		if (size == 0)
+			break;
+		if (mark == (size_t)-1 && used + width > room - 1)
+			mark = i;
+		if (used + width > room)
+			break;
+		used += width;
+	}
+	disp->view_end = split_at(line, i) && size > 0 ? mark : i;
+	ll_buf_truncate(&disp->view, 0);
+	if (left)
+		ll_buf_append_char(&disp->view, '<');
+	split_append(&disp->view, line, disp->view_begin, disp->view_end);
+	if (disp->view_end != i)
+		ll_buf_append_char(&disp->view, '>');
+	return cursor - disp->view_begin + left;
+}
+
+static void update(struct ll_display *disp, const char *prompt,
+		const char *line, size_t line_len, const char *tail,
+		size_t tail_len, size_t cursor, size_t mark_begin,
+		size_t mark_end, int mark_dim)
+{
+	struct ll_layout *lay = &disp->shown;
+	size_t prompt_len = strlen(prompt);
+	const char *old = lay->src.str + lay->prompt;
+	size_t old_len = lay->src.len - lay->prompt;
+	size_t old_end;
+	size_t common;
+	size_t first;
+	size_t last;
+	size_t from;
+	size_t n;
+
+	/* Find the first byte that changed, or whose marking did */
+	common = common_prefix(prompt, prompt_len, lay->src.str, lay->prompt);
+	if (common == prompt_len && common == lay->prompt) {
+		n = common_prefix(line, line_len, old, old_len);
+		if (n == line_len)
+			n += common_prefix(tail, tail_len, old + n, old_len - n);
+		common += n;
+	}
+	if (mark_end > line_len + tail_len)
+		mark_end = line_len + tail_len;
+	if (mark_begin < mark_end) {
+		mark_begin += prompt_len;
+		mark_end += prompt_len;
+	} else {
+		mark_begin = 0;
+		mark_end = 0;
+	}
+	/* If only the marking changed, and only up to some byte, what comes
+	 * after it stays as it is too */
+	last = (size_t)-1;
+	if (common == lay->src.len
+			&& common == prompt_len + line_len + tail_len)
+		last = mark_change_end(lay, mark_begin, mark_end, mark_dim);
+	common = mark_change(lay, common, mark_begin, mark_end, mark_dim);
+	/* Everything before its cell stays as it is: replace the rest */
+	first = layout_find(lay, common);
+	common = lay->cells[first].src;
+	old_end = lay->cells[lay->len - 1].pos;
+	if (common < prompt_len + line_len + tail_len || common < lay->src.len) {
+		ll_buf_truncate(&lay->src, common);
+		if (common < prompt_len)
+			ll_buf_append(&lay->src, prompt + common, prompt_len - common);
+		from = common > prompt_len ? common - prompt_len : 0;
+		if (from < line_len)
+			ll_buf_append(&lay->src, line + from, line_len - from);
+		from = from > line_len ? from - line_len : 0;
+		ll_buf_append(&lay->src, tail + from, tail_len - from);
+		lay->prompt = prompt_len;
+		lay->mark_begin = mark_begin;
+		lay->mark_end = mark_end;
+		lay->mark_dim = mark_dim;
+		ll_buf_truncate(&lay->text, lay->cells[first].out);
+		lay->len = first;
+		layout_format(lay, disp->cols, common, lay->cells[first].pos);
+		if (last < lay->src.len)
+			redraw_range(disp, first, layout_find(lay, last));
+		else
+			redraw(disp, first, old_end);
+	}
+	move_to(disp, lay->cells[layout_find(lay, prompt_len + cursor)].pos);
+}
+
+void ll_display_init(struct ll_display *disp, int fd)
+{
+	ll_display_init_alloc(disp, fd, &ll_heap_allocator);
+}
+
+void ll_display_init_alloc(struct ll_display *disp, int fd,
+		const struct ll_allocator *alloc)
+{
+	disp->fd = fd;
+	disp->cols = 0;
+	disp->width_checked = 0;
+	ll_buf_init_alloc(&disp->frame, alloc);
+	memset(&disp->stats, 0, sizeof(disp->stats));
+	layout_init(&disp->shown, alloc);
+	disp->cursor = 0;
+	disp->hscroll = 0;
+	disp->mark_begin = 0;
+	disp->mark_end = 0;
+	disp->mark_dim = 0;
+	ll_buf_init_alloc(&disp->view, alloc);
+	disp->view_begin = 0;
+	disp->view_end = 0;
+}
+
+void ll_display_deinit(struct ll_display *disp)
+{
+	ll_buf_deinit(&disp->frame);
+	layout_deinit(&disp->shown);
+	ll_buf_deinit(&disp->view);
+}
+
+void ll_display_reset(struct ll_display *disp)
+{
+	layout_clear(&disp->shown);
+	disp->width_checked = 0;
+	disp->cursor = 0;
+	disp->view_begin = 0;
+	disp->view_end = 0;
+}
+
+void ll_display_resized(struct ll_display *disp)
+{
+	disp->width_checked = 0;
+}
+
+void ll_display_put(struct ll_display *disp, const void *str, size_t len)
+{
+	size_t done;
+	size_t left;
+
+	done = disp->frame.len;
+	ll_buf_append(&disp->frame, str, len);
+	done = disp->frame.len - done;
+	if (done < len && ll_display_flush(disp) == 0) {
+		/* The frame is as big as it can get: send it as it is, and then
+		 * the rest, keeping what the terminal can't take yet */
+		left = write_all(disp, (const char *)str + done, len - done);
+		ll_buf_append(&disp->frame, (const char *)str + len - left, left);
+	}
+}
+
+void ll_display_putc(struct ll_display *disp, int c)
+{
+	char ch = c;
+
+	ll_display_put(disp, &ch, 1);
+}
+
+void ll_display_render(struct ll_display *disp, const char *prompt,
+		const char *line, size_t line_len, size_t cursor)
+{
+	ll_display_render_split(disp, prompt, line, line_len, "", 0, cursor);
+}
+
+void ll_display_render_split(struct ll_display *disp, const char *prompt,
+		const char *line, size_t line_len, const char *tail,
+		size_t tail_len, size_t cursor)
+{
+	size_t mark_begin = disp->mark_begin;
+	size_t mark_end = disp->mark_end;
+	struct split pieces;
+	size_t left;
+
+	check_width(disp);
+	if (disp->hscroll && disp->cols > 0) {
+		/* Scrolling only looks around the cursor, through both pieces
+		 * as they are */
+		pieces.line = line;
+		pieces.line_len = line_len;
+		pieces.tail = tail;
+		pieces.tail_len = tail_len;
+		/* What is compared with the line shown is then only the part
+		 * in view */
+		cursor = scroll_view(disp, prompt, &pieces, cursor);
+		line = disp->view.str;
+		line_len = disp->view.len;
+		tail_len = 0;
+		/* Only the part of the mark that is shown is kept, where it
+		 * is in the view */
+		left = disp->view_begin > 0;
+		if (mark_begin < disp->view_begin)
+			mark_begin = disp->view_begin;
+		if (mark_end > disp->view_end)
+			mark_end = disp->view_end;
+		if (mark_begin < mark_end) {
+			mark_begin += left - disp->view_begin;
+			mark_end += left - disp->view_begin;
+		}
+	}
+	update(disp, prompt, line, line_len, tail, tail_len, cursor,
+			mark_begin, mark_end, disp->mark_dim);
+}
+
+int ll_display_move(struct ll_display *disp, size_t cursor)
+{
+	struct ll_layout *lay = &disp->shown;
+	size_t left;
+
+	if (check_width(disp) && disp->hscroll)
+		return -1;
+	if (disp->hscroll && disp->cols > 0) {
+		/* The character must be shown, and not behind the marker */
+		left = disp->view_begin > 0;
+		if (cursor < disp->view_begin || cursor > disp->view_end
+				|| (cursor == disp->view_end && disp->view.len
+					> disp->view_end - disp->view_begin + left))
+			return -1;
+		cursor = cursor - disp->view_begin + left;
+	}
+	move_to(disp, lay->cells[layout_find(lay, lay->prompt + cursor)].pos);
+	return 0;
+}
+
+void ll_display_finish(struct ll_display *disp)
+{
+	struct ll_layout *lay = &disp->shown;
+	size_t end = lay->cells[lay->len - 1].pos;
+
+	move_to(disp, end);
+	if (disp->cols == 0 || end == 0 || end % disp->cols != 0)
+		ll_display_putc(disp, '\n');
+	ll_display_reset(disp);
+}
+
+static size_t write_all(struct ll_display *disp, const char *str, size_t len)
+{
+	ssize_t written;
+
+	while (len > 0) {
+		written = write(disp->fd, str, len);
+		++disp->stats.last_syscalls;
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		str += written;
+		len -= written;
+	}
+	return len;
+}
+
+int ll_display_flush(struct ll_display *disp)
+{
+	size_t left;
+
+	disp->stats.last_syscalls = 0;
+	left = write_all(disp, disp->frame.str, disp->frame.len);
+	disp->stats.last_bytes = disp->frame.len - left;
+	if (disp->stats.last_bytes > 0)
+		++disp->stats.frames;
+	disp->stats.bytes += disp->stats.last_bytes;
+	disp->stats.syscalls += disp->stats.last_syscalls;
+	if (left > 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+		/* Keep what the terminal can't take yet, to be sent before
+		 * anything else */
+		ll_buf_erase(&disp->frame, 0, disp->stats.last_bytes);
+		return 1;
+	}
+	ll_buf_truncate(&disp->frame, 0);
+	return left == 0 ? 0 : -1;
+}
@@ -0,0 +1,183 @@
+/* Copyright 2017 Luis Sanz <luis.sanz@gmail.com> */
+
+#ifndef LITTLELINE_DISPLAY_H_
+#define LITTLELINE_DISPLAY_H_
+
+#include <signal.h>
+#include <stdlib.h>
+
+#include "buffer.h"
+
+/**
+ * Display
+ * -------
+ *
+ * The display keeps a copy of what is currently printed on the terminal, so
+ * that every redraw only needs to send the part of the line that actually
+ * changed. Output is assembled in a frame buffer and written in a single call.
+ */
+
+/**
+ * Output statistics
+ *
+ * Every redraw of the line is assembled in memory and written to the terminal
+ * as a single frame; these numbers allow checking how much it costs
+ */
+struct ll_frame_stats {
+	/* Bytes written by the last frame */
+	size_t last_bytes;
+	/* Calls to write() needed by the last frame */
+	size_t last_syscalls;
+	/* Total number of frames written */
+	size_t frames;
+	/* Total number of bytes written */
+	size_t bytes;
+	/* Total number of calls to write() */
+	size_t syscalls;
+};
+
+/**
+ * A character as printed on the terminal
+ */
+struct ll_cell {
+	/* Offset of its first byte in the prompt and line */
+	size_t src;
+	/* Offset of its formatted representation */
+	size_t out;
+	/* Position where it is printed, counting from the start of the prompt;
+	 * with a terminal ``cols`` wide, it goes to row ``pos / cols`` and column
+	 * ``pos % cols`` */
+	size_t pos;
+};
+
+/**
+ * A formatted line: the prompt and line as they were given, the bytes sent to
+ * the terminal and where every printed character starts; the last cell marks
+ * the end of the line
+ */
+struct ll_layout {
+	/* Prompt followed by the line */
+	struct ll_buf src;
+	/* Number of bytes of src that belong to the prompt */
+	size_t prompt;
+	/* Formatted text */
+	struct ll_buf text;
+	/* Printed characters */
+	struct ll_cell *cells;
+	/* Number of cells currently allocated */
+	size_t allocated;
+	/* Number of cells used, including the one marking the end */
+	size_t len;
+	/* Bytes of src from mark_begin to before mark_end are shown in reverse
+	 * video, or dimmed if mark_dim is set; none are if both are the same */
+	size_t mark_begin;
+	size_t mark_end;
+	int mark_dim;
+	/* Where the memory for the cells comes from */
+	const struct ll_allocator *alloc;
+};
+
+/**
+ * State of the terminal
+ */
+struct ll_display {
+	/* File descriptor the frames are written to */
+	int fd;
+	/* Width of the terminal, or 0 if lines never wrap */
+	size_t cols;
+	/* Set once the width has been checked since the display was reset, and
+	 * cleared when the terminal is resized */
+	volatile sig_atomic_t width_checked;
+	/* Output for the frame currently being drawn */
+	struct ll_buf frame;
+	/* Statistics of the frames written so far */
+	struct ll_frame_stats stats;
+	/* What is currently printed */
+	struct ll_layout shown;
+	/* Position of the terminal cursor */
+	size_t cursor;
+	/* If set, long lines scroll horizontally in a single row instead of
+	 * wrapping */
+	int hscroll;
+	/* Part of the line to render that is shown in reverse video, e.g. to
+	 * highlight a match, from the byte whose index is mark_begin to before
+	 * mark_end; none is if both are the same. If mark_dim is set, it is
+	 * dimmed instead, e.g. for text suggested after the cursor */
+	size_t mark_begin;
+	size_t mark_end;
+	int mark_dim;
+	/* When scrolling, the part of the line shown, with its markers */
+	struct ll_buf view;
+	/* Index in the line of the first and after the last byte shown */
+	size_t view_begin;
+	size_t view_end;
+};
+
+/**
+ * Initialize display, writing to ``fd``
+ */
+void ll_display_init(struct ll_display *disp, int fd);
+/**
+ * Same as ``ll_display_init()``, taking memory from ``alloc``
+ */
+void ll_display_init_alloc(struct ll_display *disp, int fd,
+		const struct ll_allocator *alloc);
+/**
+ * Destroy display
+ */
+void ll_display_deinit(struct ll_display *disp);
+/**
+ * Forget about what is printed; the next line will be drawn from the
+ * current position of the terminal cursor, that must be at the first column
+ */
+void ll_display_reset(struct ll_display *disp);
+/**
+ * Note that the terminal may have been resized, so that the display checks
+ * its width again before drawing; it is safe to call from a signal handler,
+ * e.g. for ``SIGWINCH``
+ */
+void ll_display_resized(struct ll_display *disp);
+/**
+ * Add ``len`` bytes of ``str`` to the frame, unformatted
+ */
+void ll_display_put(struct ll_display *disp, const void *str, size_t len);
+/**
+ * Add a character to the frame, unformatted
+ */
+void ll_display_putc(struct ll_display *disp, int c);
+/**
+ * Add to the frame whatever is needed to show ``prompt`` followed by the
+ * ``line_len`` bytes of ``line`` with the cursor at the character of ``line``
+ * whose index is ``cursor``; the prompt is printed verbatim, and may contain
+ * escape sequences
+ */
+void ll_display_render(struct ll_display *disp, const char *prompt,
+		const char *line, size_t line_len, size_t cursor);
+/**
+ * Same as ``ll_display_render()`` for a line given in two pieces, ``line``
+ * followed by ``tail``, e.g. the text at both sides of the gap of a gap
+ * buffer
+ */
+void ll_display_render_split(struct ll_display *disp, const char *prompt,
+		const char *line, size_t line_len, const char *tail,
+		size_t tail_len, size_t cursor);
+/**
+ * Add to the frame whatever is needed to put the cursor at the character
+ * whose index is ``cursor``, assuming the line has not changed since it was
+ * last rendered; if the line is scrolled and that character is not shown,
+ * return -1 and leave the frame as it was
+ */
+int ll_display_move(struct ll_display *disp, size_t cursor);
+/**
+ * Add to the frame whatever is needed to leave the cursor in a new line
+ * after the one shown
+ */
+void ll_display_finish(struct ll_display *disp);
+/**
+ * Write the frame to the terminal in one go; return 0 once written, or -1 on
+ * error. If the terminal can't take all of it without blocking, return 1 and
+ * keep the rest, to be written first by the next call
+ */
+int ll_display_flush(struct ll_display *disp);
+
+#endif
@@ -0,0 +1,141 @@
+/* Copyright 2017 Luis Sanz <luis.sanz@gmail.com> */
+
+#include "gap.h"
+
+/* Make sure the gap has room for at least len characters; return -1 if there
+ * is no memory */
+static int gap_grow(struct ll_gap *gap, size_t len);
+
+void ll_gap_init(struct ll_gap *gap)
+{
+	ll_gap_init_alloc(gap, &ll_heap_allocator);
+}
+
+void ll_gap_init_alloc(struct ll_gap *gap, const struct ll_allocator *alloc)
+{
+	gap->alloc = alloc;
+	gap->str = alloc->malloc(alloc->user, LL_BUF_BUCKET_SIZE);
+	gap->allocated = gap->str != NULL ? LL_BUF_BUCKET_SIZE : 0;
+	gap->begin = 0;
+	gap->end = gap->allocated;
+}
+
+void ll_gap_deinit(struct ll_gap *gap)
+{
+	gap->alloc->free(gap->alloc->user, gap->str, gap->allocated);
+}
+
+static int gap_grow(struct ll_gap *gap, size_t len)
+{
+	size_t tail = gap->allocated - gap->end;
+	size_t text = gap->begin + tail;
+	size_t allocated;
+	char *str;
+
+	if (gap->end - gap->begin >= len)
+		return 0;
+	allocated = ll_grow_size(gap->allocated, text + len);
+	if (gap->str == NULL)
+		str = gap->alloc->malloc(gap->alloc->user, allocated);
+	else
+		str = gap->alloc->realloc(gap->alloc->user, gap->str,
+				gap->allocated, allocated);
+	if (str == NULL)
+		return -1;
+	memmove(str + (allocated - tail), str + gap->end, tail);
+	gap->str = str;
+	gap->allocated = allocated;
+	gap->end = allocated - tail;
+	return 0;
+}
+
+size_t ll_gap_len(const struct ll_gap *gap)
+{
+	return gap->allocated - (gap->end - gap->begin);
+}
+
+char ll_gap_at(const struct ll_gap *gap, size_t where)
+{
+	if (where < gap->begin)
+		return gap->str[where];
+	where += gap->end - gap->begin;
+	if (where < gap->allocated)
+		return gap->str[where];
+	return 0;
+}
+
+void ll_gap_assign(struct ll_gap *gap, const void *str, size_t len)
+{
+	gap->begin = 0;
+	gap->end = gap->allocated;
+	if (gap_grow(gap, len + 1) != 0) {
+		if (gap->str == NULL)
+			return;
+		len = gap->end - gap->begin - 1;
+	}
+	memcpy(gap->str, str, len);
+	gap->begin = len;
+}
+
+void ll_gap_move(struct ll_gap *gap, size_t where)
+{
+	size_t len;
+
+	assert(where <= ll_gap_len(gap));
+	if (where < gap->begin) {
+		len = gap->begin - where;
+		memmove(gap->str + (gap->end - len), gap->str + where, len);
+		gap->begin -= len;
+		gap->end -= len;
+	} else if (where > gap->begin) {
+		len = where - gap->begin;
+		memmove(gap->str + gap->begin, gap->str + gap->end, len);
+		gap->begin += len;
+		gap->end += len;
+	}
+}
+
+void ll_gap_insert(struct ll_gap *gap, size_t where, const void *str,
+		size_t len)
+{
+	ll_gap_move(gap, where);
+	if (gap_grow(gap, len + 1) != 0) {
+		if (gap->str == NULL)
+			return;
+		len = gap->end - gap->begin - 1;
+	}
+	memcpy(gap->str + gap->begin, str, len);
+	gap->begin += len;
+}
+
+void ll_gap_insert_char(struct ll_gap *gap, size_t where, char c)
+{
+	ll_gap_insert(gap, where, &c, 1);
+}
+
+void ll_gap_erase(struct ll_gap *gap, size_t where, size_t len)
+{
+	assert(where + len <= ll_gap_len(gap));
+	ll_gap_move(gap, where);
+	gap->end += len;
+}
+
+const char *ll_gap_span(struct ll_gap *gap, size_t where, size_t len)
+{
+	assert(where + len <= ll_gap_len(gap));
+	if (where + len <= gap->begin)
+		return gap->str + where;
+	if (where >= gap->begin)
+		return gap->str + (where + (gap->end - gap->begin));
+	ll_gap_move(gap, where);
+	return gap->str + gap->end;
+}
+
+const char *ll_gap_str(struct ll_gap *gap)
+{
+	if (gap->str == NULL)
+		return "";
+	ll_gap_move(gap, ll_gap_len(gap));
+	gap->str[gap->begin] = 0;
+	return gap->str;
+}
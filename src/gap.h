@@ -0,0 +1,96 @@
+/* Copyright 2017 Luis Sanz <luis.sanz@gmail.com> */
+
+#ifndef LITTLELINE_GAP_H_
+#define LITTLELINE_GAP_H_
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+
+/**
+ * Gap Buffer
+ * ----------
+ *
+ * A gap buffer holds the line being edited. The free space of the buffer is
+ * kept as a gap in the middle of the text, right where the last edit took
+ * place, so that typing or deleting there only costs as much as the edit
+ * itself instead of moving all the text after it.
+ */
+
+/**
+ * Text with a gap
+ *
+ * The text is made of the first ``begin`` characters of ``str`` followed by
+ * the ones from ``end`` up to ``allocated``; the gap is never empty, so there
+ * is always room to terminate the text
+ */
+struct ll_gap {
+	/* Text before and after the gap */
+	char *str;
+	/* Number of characters currently allocated */
+	size_t allocated;
+	/* Index of the first character of the gap, and of the first one after it */
+	size_t begin;
+	size_t end;
+	/* Where the memory for the text comes from */
+	const struct ll_allocator *alloc;
+};
+
+/**
+ * Initialize gap buffer
+ */
+void ll_gap_init(struct ll_gap *gap);
+/**
+ * Initialize gap buffer, taking memory from ``alloc``; if there is not
+ * enough, text that would make the buffer grow is cut down to what fits
+ */
+void ll_gap_init_alloc(struct ll_gap *gap, const struct ll_allocator *alloc);
+/**
+ * Destroy gap buffer
+ */
+void ll_gap_deinit(struct ll_gap *gap);
+/**
+ * Return the number of characters in ``gap``
+ */
+size_t ll_gap_len(const struct ll_gap *gap);
+/**
+ * Return the character at position ``where`` of ``gap``, or 0 if it is past
+ * the end of the text
+ */
+char ll_gap_at(const struct ll_gap *gap, size_t where);
+/**
+ * Replace the contents of ``gap`` with ``len`` characters from ``str``
+ */
+void ll_gap_assign(struct ll_gap *gap, const void *str, size_t len);
+/**
+ * Move the gap to position ``where``
+ */
+void ll_gap_move(struct ll_gap *gap, size_t where);
+/**
+ * Insert ``len`` characters of ``str`` at position ``where`` of ``gap``
+ */
+void ll_gap_insert(struct ll_gap *gap, size_t where, const void *str,
+		size_t len);
+/**
+ * Insert character; same as ``ll_gap_insert(gap, where, &c, 1)``
+ */
+void ll_gap_insert_char(struct ll_gap *gap, size_t where, char c);
+/**
+ * Erase ``len`` characters of ``gap`` starting at ``where``
+ */
+void ll_gap_erase(struct ll_gap *gap, size_t where, size_t len);
+/**
+ * Return the ``len`` characters of ``gap`` starting at ``where`` in a single
+ * piece, moving the gap out of the way if needed; the pointer is valid until
+ * ``gap`` is modified
+ */
+const char *ll_gap_span(struct ll_gap *gap, size_t where, size_t len);
+/**
+ * Return the whole text of ``gap`` as a string, moving the gap to its end;
+ * the pointer is valid until ``gap`` is modified
+ */
+const char *ll_gap_str(struct ll_gap *gap);
+
+#endif
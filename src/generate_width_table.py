@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+
+"""Generate the table with the width of every Unicode code point.
+
+The table has two levels: the code point divided by BLOCK_SIZE indexes a
+table of blocks, and the rest indexes the block, that holds two bits per code
+point. Blocks are shared, so the whole table is a few kilobytes.
+"""
+
+import unicodedata
+
+BLOCK_SIZE = 256
+MAX_CODE_POINT = 0x110000
+
+
+def width(cp):
+    c = chr(cp)
+    category = unicodedata.category(c)
+    # Combining marks and format characters take no room
+    if category in ('Mn', 'Me') or (category == 'Cf' and cp != 0x00AD):
+        return 0
+    # Hangul medial vowels and final consonants join the previous syllable
+    if 0x1160 <= cp <= 0x11FF or 0xD7B0 <= cp <= 0xD7FF:
+        return 0
+    if cp == 0x200B:
+        return 0
+    if unicodedata.east_asian_width(c) in ('W', 'F'):
+        return 2
+    return 1
+
+
+def main():
+    blocks = []
+    index = []
+    known = {}
+    for base in range(0, MAX_CODE_POINT, BLOCK_SIZE):
+        packed = [0] * (BLOCK_SIZE // 4)
+        for cp in range(base, base + BLOCK_SIZE):
+            packed[(cp - base) // 4] |= width(cp) << (2 * (cp % 4))
+        packed = tuple(packed)
+        if packed not in known:
+            known[packed] = len(blocks)
+            blocks.append(packed)
+        index.append(known[packed])
+    index_type = 'unsigned char' if len(blocks) <= 256 else 'unsigned short'
+
+    print('/* Generated by generate_width_table.py from Unicode %s; do not edit */'
+          % unicodedata.unidata_version)
+    print('')
+    print('#define LL_WIDTH_BLOCK_SIZE %d' % BLOCK_SIZE)
+    print('#define LL_WIDTH_MAX_CODE_POINT 0x%X' % MAX_CODE_POINT)
+    print('')
+    print('static const %s ll_width_index[%d] = {' % (index_type, len(index)))
+    for i in range(0, len(index), 16):
+        print('\t' + ', '.join('%d' % x for x in index[i:i + 16]) + ',')
+    print('};')
+    print('')
+    print('static const unsigned char ll_width_blocks[%d][%d] = {'
+          % (len(blocks), BLOCK_SIZE // 4))
+    for block in blocks:
+        print('\t{')
+        for i in range(0, len(block), 16):
+            print('\t\t' + ', '.join('0x%02X' % x for x in block[i:i + 16])
+                  + ',')
+        print('\t},')
+    print('};')
+
+
+if __name__ == '__main__':
+    main()
@@ -3,106 +3,1156 @@
 #include "history.h"
 
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <string.h>
 #include <stdio.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 
 #include "buffer.h"
 
+/* Size of the buffer used to write a history file */
+#define LL_HISTORY_WRITE_SIZE 4096
+/* Size of the pieces a history file that can't be mapped is read in */
+#define LL_HISTORY_READ_SIZE 4096
+/* Hash of an empty prefix */
+#define LL_PREFIX_HASH 2166136261u
+
+/* A line of a file being read */
+struct file_line {
+	const char *str;
+	size_t len;
+};
+
+/* Return the index in lines of the string at position pos, counting the
+ * erased ones from the oldest on */
+static size_t history_slot(const struct ll_history *hist, size_t pos);
+/* Return the string at position pos */
+static const struct ll_history_line *history_at(
+		const struct ll_history *hist, size_t pos);
+/* Return whether the string in the slot of lines given is erased */
+static int history_erased(const struct ll_history *hist, size_t slot);
+/* Return the index in lines of the string whose index is given */
+static size_t history_find(const struct ll_history *hist, size_t index);
+/* Return the position of the string whose index is given, or the one after
+ * the newest string if there is none */
+static size_t history_position(const struct ll_history *hist,
+		size_t index);
+/* Return the number of strings held before position pos */
+static size_t history_rank(const struct ll_history *hist, size_t pos);
+/* Return the offset of the byte after the newest string */
+static size_t history_tail(const struct ll_history *hist);
+/* Return the offset where len bytes fit without touching any string, or -1
+ * if there is no room */
+static size_t history_room(const struct ll_history *hist, size_t len);
+/* Make the buffer of bytes at least len bytes bigger; return -1 if there is
+ * no memory */
+static int history_grow(struct ll_history *hist, size_t len);
+/* Return whether the len bytes of line are all blank */
+static int history_blank(const char *line, size_t len);
+/* Return the length of the string between line and end, which ends at the
+ * first NUL character if there is one */
+static size_t history_line_len(const char *line, const char *end);
+/* Return where the lines to load from the file between data and end start,
+ * going backwards until the last ones that fill the history are found */
+static const char *history_window(const struct ll_history *hist,
+		const char *data, const char *end);
+/* Load the lines of the size bytes of a file at data */
+static void history_load(struct ll_history *hist, const char *data,
+		size_t size);
+/* Add the len bytes of line to the size slots of seen, a hash set; return 1
+ * if it was not there yet, and 0 otherwise */
+static int window_add(struct file_line *seen, size_t size, const char *line,
+		size_t len);
+/* Push the len bytes of line, which has no NUL characters */
+static int history_push(struct ll_history *hist, const char *line,
+		size_t len);
+/* Drop the oldest string, and the erased ones right after it */
+static void history_drop(struct ll_history *hist);
+/* Erase the string at position pos */
+static void history_erase(struct ll_history *hist, size_t pos);
+/* Return the position of the string held with the len bytes of line, or -1
+ * if there is none */
+static size_t history_copy(const struct ll_history *hist, const char *line,
+		size_t len);
+/* Take back the room of all the erased strings */
+static void history_compact(struct ll_history *hist);
+/* Move the strings to a list of the given number of slots; return -1 if
+ * there is no memory */
+static int history_reslot(struct ll_history *hist, size_t slots);
+/* Add delta to the number of strings held in the slot of lines given */
+static void held_add(struct ll_history *hist, size_t slot, int delta);
+/* Return the number of strings held in the slots of lines before the one
+ * given */
+static size_t held_before(const struct ll_history *hist, size_t slot);
+/* Return the slot of lines where the string held after k others is */
+static size_t held_select(const struct ll_history *hist, size_t k);
+/* Set up the buckets of index for as many strings as hist holds */
+static void index_init(struct ll_history *hist,
+		struct ll_history_index *index);
+/* Release the buckets of index, so that searches go through every string
+ * instead */
+static void index_free(struct ll_history *hist,
+		struct ll_history_index *index);
+/* Return the bucket of index for hash */
+static struct ll_history_bucket *index_bucket(
+		const struct ll_history_index *index, uint32_t hash);
+/* Add id to the bucket for hash, unless it was just added to it; return -1
+ * if there is no memory */
+static int index_add(struct ll_history *hist, struct ll_history_index *index,
+		uint32_t hash, uint32_t id);
+/* Remove id from the bucket for hash, if it comes first in it */
+static void index_remove(struct ll_history_index *index, uint32_t hash,
+		uint32_t id);
+/* Return the place in bucket, or among all the strings if it is NULL, of
+ * the first string whose position is at least pos */
+static size_t bucket_find(const struct ll_history *hist,
+		const struct ll_history_bucket *bucket, size_t pos);
+/* Return the position of the string at place i of bucket, or i if it is
+ * NULL */
+static size_t bucket_at(const struct ll_history *hist,
+		const struct ll_history_bucket *bucket, size_t i);
+/* Return the hash of the trigram at str */
+static uint32_t trigram_hash(const char *str);
+/* Return the hash of a prefix ending in c, given the hash of the rest of it */
+static uint32_t prefix_hash(uint32_t hash, unsigned char c);
+/* Return the hash of the len bytes of str */
+static uint32_t string_hash(const char *str, size_t len);
+/* Return 1 if the beginnings of strings len bytes long are hashed */
+static int prefix_hashed(size_t len);
+/* Add the id of the len bytes of line to the indexes */
+static void history_index(struct ll_history *hist, uint32_t id,
+		const char *line, size_t len);
+/* Remove it from them, once it is the oldest one */
+static void history_unindex(struct ll_history *hist, uint32_t id,
+		const char *line, size_t len);
+/* Return whether the string at position pos is held and starts with the
+ * len bytes of prefix */
+static int starts_with(struct ll_history *hist, size_t pos,
+		const char *prefix, size_t len);
+/* Look for a string starting with the len bytes of prefix, going from the
+ * one whose index is *index back if older is set, or else on */
+static int search_prefix(struct ll_history *hist, const char *prefix,
+		size_t len, size_t *index, int older);
+/* Write len bytes of str to the file descriptor fd; return -1 on failure */
+static int write_all(int fd, const char *str, size_t len);
+
 void ll_history_init(struct ll_history *hist, size_t allocated)
 {
-	hist->data = calloc(allocated, sizeof(*hist->data));
+	ll_history_init_alloc(hist, allocated, &ll_heap_allocator);
+}
+
+void ll_history_init_alloc(struct ll_history *hist, size_t allocated,
+		const struct ll_allocator *alloc)
+{
+	hist->alloc = alloc;
+	hist->lines = alloc->malloc(alloc->user,
+			allocated * sizeof(*hist->lines));
+	if (hist->lines == NULL)
+		allocated = 0;
 	hist->allocated = allocated;
+	hist->slots = allocated;
+	hist->bytes = NULL;
+	hist->bytes_allocated = 0;
 	hist->size = 0;
+	hist->erased = 0;
 	hist->end = 0;
+	hist->file_lines = 0;
+	hist->next_id = 0;
+	hist->erase_dups = 0;
+	hist->held = NULL;
+	index_init(hist, &hist->trigrams);
+	index_init(hist, &hist->prefixes);
+	hist->strings.buckets = NULL;
+	hist->strings.size = 0;
 }
 
 void ll_history_deinit(struct ll_history *hist)
 {
-	free(hist->data);
+	hist->alloc->free(hist->alloc->user, hist->lines,
+			hist->slots * sizeof(*hist->lines));
+	hist->alloc->free(hist->alloc->user, hist->bytes,
+			hist->bytes_allocated);
+	hist->alloc->free(hist->alloc->user, hist->held,
+			hist->slots * sizeof(*hist->held));
+	index_free(hist, &hist->trigrams);
+	index_free(hist, &hist->prefixes);
+	index_free(hist, &hist->strings);
 }
 
 void ll_history_clear(struct ll_history *hist)
 {
-	int i;
+	/* Every string goes away as the oldest one */
+	while (hist->size > 0)
+		history_drop(hist);
+	hist->end = 0;
+}
+
+static void index_init(struct ll_history *hist,
+		struct ll_history_index *index)
+{
+	const struct ll_allocator *alloc = hist->alloc;
+	size_t size = 1;
+
+	index->buckets = NULL;
+	index->size = 0;
+	if (hist->allocated == 0)
+		return;
+	while (size < hist->allocated && size < LL_HISTORY_BUCKETS)
+		size *= 2;
+	index->buckets = alloc->malloc(alloc->user,
+			size * sizeof(*index->buckets));
+	if (index->buckets == NULL)
+		return;
+	memset(index->buckets, 0, size * sizeof(*index->buckets));
+	index->size = size;
+}
+
+static void index_free(struct ll_history *hist,
+		struct ll_history_index *index)
+{
+	const struct ll_allocator *alloc = hist->alloc;
+	size_t i;
+
+	if (index->buckets == NULL)
+		return;
+	for (i = 0; i < index->size; ++i)
+		alloc->free(alloc->user, index->buckets[i].ids,
+				index->buckets[i].allocated
+				* sizeof(*index->buckets[i].ids));
+	alloc->free(alloc->user, index->buckets,
+			index->size * sizeof(*index->buckets));
+	index->buckets = NULL;
+	index->size = 0;
+}
+
+static struct ll_history_bucket *index_bucket(
+		const struct ll_history_index *index, uint32_t hash)
+{
+	hash *= 2654435761u;
+	return &index->buckets[(hash >> 16) & (index->size - 1)];
+}
+
+static int index_add(struct ll_history *hist, struct ll_history_index *index,
+		uint32_t hash, uint32_t id)
+{
+	const struct ll_allocator *alloc = hist->alloc;
+	struct ll_history_bucket *bucket = index_bucket(index, hash);
+	size_t allocated;
+	uint32_t *ids;
+
+	/* The string may have the same part more than once */
+	if (bucket->len > bucket->begin && bucket->ids[bucket->len - 1] == id)
+		return 0;
+	if (bucket->len == bucket->allocated && bucket->begin > 0) {
+		/* Make use of the room left by the strings gone */
+		memmove(bucket->ids, bucket->ids + bucket->begin,
+				(bucket->len - bucket->begin) * sizeof(*ids));
+		bucket->len -= bucket->begin;
+		bucket->begin = 0;
+	} else if (bucket->len == bucket->allocated) {
+		allocated = bucket->allocated > 0 ? 2 * bucket->allocated : 4;
+		ids = alloc->realloc(alloc->user, bucket->ids,
+				bucket->allocated * sizeof(*ids),
+				allocated * sizeof(*ids));
+		if (ids == NULL)
+			return -1;
+		bucket->ids = ids;
+		bucket->allocated = allocated;
+	}
+	bucket->ids[bucket->len++] = id;
+	return 0;
+}
+
+static void index_remove(struct ll_history_index *index, uint32_t hash,
+		uint32_t id)
+{
+	struct ll_history_bucket *bucket = index_bucket(index, hash);
+
+	if (bucket->begin < bucket->len && bucket->ids[bucket->begin] == id)
+		++bucket->begin;
+	if (bucket->begin == bucket->len) {
+		bucket->begin = 0;
+		bucket->len = 0;
+	}
+}
+
+static size_t bucket_find(const struct ll_history *hist,
+		const struct ll_history_bucket *bucket, size_t pos)
+{
+	size_t used = hist->size + hist->erased;
+	uint32_t oldest = hist->next_id - used;
+	size_t lo;
+	size_t hi;
+	size_t mid;
+
+	if (bucket == NULL)
+		return pos < used ? pos : used;
+	/* Ids grow from the oldest string on */
+	lo = bucket->begin;
+	hi = bucket->len;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if ((uint32_t)(bucket->ids[mid] - oldest) < pos)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static size_t bucket_at(const struct ll_history *hist,
+		const struct ll_history_bucket *bucket, size_t i)
+{
+	if (bucket == NULL)
+		return i;
+	return (uint32_t)(bucket->ids[i]
+			- (hist->next_id - (hist->size + hist->erased)));
+}
+
+static uint32_t trigram_hash(const char *str)
+{
+	const unsigned char *bytes = (const unsigned char *)str;
+
+	return (uint32_t)bytes[0] << 16 | (uint32_t)bytes[1] << 8 | bytes[2];
+}
+
+static uint32_t prefix_hash(uint32_t hash, unsigned char c)
+{
+	return (hash ^ c) * 16777619u;
+}
+
+static uint32_t string_hash(const char *str, size_t len)
+{
+	uint32_t hash = LL_PREFIX_HASH;
+
+	while (len-- > 0)
+		hash = prefix_hash(hash, *str++);
+	return hash;
+}
+
+static int prefix_hashed(size_t len)
+{
+	return len <= LL_HISTORY_PREFIX
+		&& (len <= 8 || (len & (len - 1)) == 0);
+}
+
+static void history_index(struct ll_history *hist, uint32_t id,
+		const char *line, size_t len)
+{
+	uint32_t hash = LL_PREFIX_HASH;
+	size_t i;
+
+	/* Searches can do without an index there is no memory for */
+	for (i = 0; hist->trigrams.buckets != NULL && i + 3 <= len; ++i)
+		if (index_add(hist, &hist->trigrams, trigram_hash(line + i),
+					id) != 0)
+			index_free(hist, &hist->trigrams);
+	for (i = 0; hist->prefixes.buckets != NULL && i < len
+			&& i < LL_HISTORY_PREFIX; ++i) {
+		hash = prefix_hash(hash, line[i]);
+		if (prefix_hashed(i + 1) && index_add(hist, &hist->prefixes,
+					hash, id) != 0)
+			index_free(hist, &hist->prefixes);
+	}
+	if (hist->strings.buckets != NULL && index_add(hist, &hist->strings,
+				string_hash(line, len), id) != 0)
+		index_free(hist, &hist->strings);
+}
+
+static void history_unindex(struct ll_history *hist, uint32_t id,
+		const char *line, size_t len)
+{
+	uint32_t hash = LL_PREFIX_HASH;
+	size_t i;
+
+	/* Being the oldest string, it comes first in all of its buckets */
+	for (i = 0; hist->trigrams.buckets != NULL && i + 3 <= len; ++i)
+		index_remove(&hist->trigrams, trigram_hash(line + i), id);
+	for (i = 0; hist->prefixes.buckets != NULL && i < len
+			&& i < LL_HISTORY_PREFIX; ++i) {
+		hash = prefix_hash(hash, line[i]);
+		if (prefix_hashed(i + 1))
+			index_remove(&hist->prefixes, hash, id);
+	}
+	if (hist->strings.buckets != NULL)
+		index_remove(&hist->strings, string_hash(line, len), id);
+}
+
+static void history_drop(struct ll_history *hist)
+{
+	const struct ll_history_line *line;
+	size_t slot;
 
-	for (i = 0; i < hist->allocated; ++i) {
-		if (hist->data[i] != NULL) {
-			free(hist->data[i]);
-			hist->data[i] = NULL;
+	/* Erased strings are never left before the oldest one held */
+	do {
+		slot = history_slot(hist, 0);
+		line = &hist->lines[slot];
+		history_unindex(hist,
+				hist->next_id - (hist->size + hist->erased),
+				hist->bytes + line->offset, line->len);
+		if (history_erased(hist, slot)) {
+			--hist->erased;
+		} else {
+			held_add(hist, slot, -1);
+			--hist->size;
 		}
+	} while (history_erased(hist, history_slot(hist, 0)));
+}
+
+static void history_erase(struct ll_history *hist, size_t pos)
+{
+	if (pos == 0) {
+		history_drop(hist);
+		return;
 	}
-	hist->size = 0;
-	hist->end = 0;
+	held_add(hist, history_slot(hist, pos), -1);
+	--hist->size;
+	++hist->erased;
 }
 
-void ll_history_push(struct ll_history *hist, const char *line)
+static size_t history_copy(const struct ll_history *hist, const char *line,
+		size_t len)
 {
-	const char *ptr;
+	const struct ll_history_bucket *bucket = NULL;
+	const struct ll_history_line *copy;
+	size_t begin = 0;
+	size_t i;
+	size_t pos;
 
-	for (ptr = line; *ptr && isspace(*ptr); ++ptr)
-		continue;
-	if ((strlen(ptr) == 0) || ((hist->size > 0)
-				&& (strcmp(ll_history_index(hist, hist->size - 1), line) == 0)))
+	/* Only the strings in the bucket of the whole of it may be the same */
+	if (hist->strings.buckets != NULL) {
+		bucket = index_bucket(&hist->strings, string_hash(line, len));
+		begin = bucket->begin;
+	}
+	for (i = bucket_find(hist, bucket, hist->size + hist->erased);
+			i > begin;) {
+		pos = bucket_at(hist, bucket, --i);
+		copy = history_at(hist, pos);
+		if (!history_erased(hist, history_slot(hist, pos))
+				&& copy->len == len
+				&& memcmp(hist->bytes + copy->offset, line,
+					len) == 0)
+			return pos;
+	}
+	return (size_t)-1;
+}
+
+static void history_compact(struct ll_history *hist)
+{
+	size_t used = hist->size + hist->erased;
+	size_t from = history_slot(hist, 0);
+	size_t to = from;
+	size_t offset = hist->lines[from].offset;
+	struct ll_history_line line;
+	size_t i;
+
+	/* All the strings get new ids: take them out of the indexes, the
+	 * oldest first, and put them back once they are in place */
+	for (i = 0; i < used; ++i)
+		history_unindex(hist, hist->next_id - used + i,
+				hist->bytes + history_at(hist, i)->offset,
+				history_at(hist, i)->len);
+	/* Move every string held back over the erased ones, in lines and in
+	 * bytes; once the strings wrap around the end of the buffer, the ones
+	 * from its start may fit at its end */
+	for (i = 0; i < used; ++i, from = (from + 1) % hist->slots) {
+		if (history_erased(hist, from))
+			continue;
+		line = hist->lines[from];
+		if (offset + line.len + 1 > hist->bytes_allocated)
+			offset = 0;
+		memmove(hist->bytes + offset, hist->bytes + line.offset,
+				line.len + 1);
+		line.offset = offset;
+		offset += line.len + 1;
+		hist->lines[to] = line;
+		to = (to + 1) % hist->slots;
+	}
+	hist->end = to;
+	hist->erased = 0;
+	memset(hist->held, 0, hist->slots * sizeof(*hist->held));
+	for (i = 0; i < hist->size; ++i)
+		held_add(hist, history_slot(hist, i), 1);
+	for (i = 0; i < hist->size; ++i)
+		history_index(hist, hist->next_id - hist->size + i,
+				ll_history_index(hist, i),
+				ll_history_len(hist, i));
+}
+
+static int history_reslot(struct ll_history *hist, size_t slots)
+{
+	const struct ll_allocator *alloc = hist->alloc;
+	struct ll_history_line *lines;
+	size_t used = hist->size + hist->erased;
+	size_t i;
+
+	lines = alloc->malloc(alloc->user, slots * sizeof(*lines));
+	if (lines == NULL)
+		return -1;
+	for (i = 0; i < used; ++i)
+		lines[i] = *history_at(hist, i);
+	alloc->free(alloc->user, hist->lines,
+			hist->slots * sizeof(*hist->lines));
+	hist->lines = lines;
+	hist->slots = slots;
+	hist->end = used % slots;
+	return 0;
+}
+
+static void held_add(struct ll_history *hist, size_t slot, int delta)
+{
+	size_t i;
+
+	if (hist->held == NULL)
 		return;
-	if (hist->size == hist->allocated)
-		free(hist->data[hist->end]);
+	for (i = slot + 1; i <= hist->slots; i += i & -i)
+		hist->held[i - 1] += delta;
+}
+
+static size_t held_before(const struct ll_history *hist, size_t slot)
+{
+	size_t count = 0;
+	size_t i;
+
+	for (i = slot; i > 0; i -= i & -i)
+		count += hist->held[i - 1];
+	return count;
+}
+
+static size_t held_select(const struct ll_history *hist, size_t k)
+{
+	size_t slot = 0;
+	size_t step = 1;
+
+	/* Go down the tree, skipping the ranges with k strings or fewer */
+	while (step * 2 <= hist->slots)
+		step *= 2;
+	for (; step > 0; step /= 2) {
+		if (slot + step <= hist->slots
+				&& hist->held[slot + step - 1] <= k) {
+			slot += step;
+			k -= hist->held[slot - 1];
+		}
+	}
+	return slot;
+}
+
+static size_t history_slot(const struct ll_history *hist, size_t pos)
+{
+	return (hist->end + hist->slots - (hist->size + hist->erased) + pos)
+		% hist->slots;
+}
+
+static const struct ll_history_line *history_at(
+		const struct ll_history *hist, size_t pos)
+{
+	return &hist->lines[history_slot(hist, pos)];
+}
+
+static int history_erased(const struct ll_history *hist, size_t slot)
+{
+	return hist->erased > 0
+		&& held_before(hist, slot + 1) == held_before(hist, slot);
+}
+
+static size_t history_find(const struct ll_history *hist, size_t index)
+{
+	size_t k;
+
+	if (hist->erased == 0)
+		return history_slot(hist, index);
+	/* Count from the start of lines, wrapping around to the oldest */
+	k = held_before(hist, history_slot(hist, 0)) + index;
+	if (k >= hist->size)
+		k -= hist->size;
+	return held_select(hist, k);
+}
+
+static size_t history_position(const struct ll_history *hist,
+		size_t index)
+{
+	if (hist->erased == 0)
+		return index;
+	if (index >= hist->size)
+		return hist->size + hist->erased;
+	return (history_find(hist, index) + hist->slots
+			- history_slot(hist, 0)) % hist->slots;
+}
+
+static size_t history_rank(const struct ll_history *hist, size_t pos)
+{
+	size_t head;
+	size_t slot;
+
+	if (hist->erased == 0)
+		return pos;
+	if (pos >= hist->size + hist->erased)
+		return hist->size;
+	head = held_before(hist, history_slot(hist, 0));
+	slot = history_slot(hist, pos);
+	if (slot >= history_slot(hist, 0))
+		return held_before(hist, slot) - head;
+	return hist->size - head + held_before(hist, slot);
+}
+
+static size_t history_tail(const struct ll_history *hist)
+{
+	const struct ll_history_line *last;
+
+	if (hist->size == 0)
+		return 0;
+	last = history_at(hist, hist->size + hist->erased - 1);
+	return last->offset + last->len + 1;
+}
+
+static size_t history_room(const struct ll_history *hist, size_t len)
+{
+	size_t head;
+	size_t tail;
+
+	if (hist->size == 0)
+		return len <= hist->bytes_allocated ? 0 : (size_t)-1;
+	head = hist->lines[history_slot(hist, 0)].offset;
+	tail = history_tail(hist);
+	if (tail > head) {
+		/* The strings are in one piece: there may be room after them,
+		 * or else before them */
+		if (hist->bytes_allocated - tail >= len)
+			return tail;
+		if (head >= len)
+			return 0;
+	} else if (head - tail >= len) {
+		/* They wrap around: there may be room between both ends */
+		return tail;
+	}
+	return (size_t)-1;
+}
+
+static int history_grow(struct ll_history *hist, size_t len)
+{
+	size_t allocated;
+	size_t head;
+	size_t delta;
+	size_t i;
+	char *bytes;
+
+	allocated = ll_grow_size(hist->bytes_allocated,
+			hist->bytes_allocated + len);
+	if (hist->bytes == NULL)
+		bytes = hist->alloc->malloc(hist->alloc->user, allocated);
 	else
-		++hist->size;
-	hist->data[hist->end] = malloc(strlen(line) + 1);
-	strcpy(hist->data[hist->end], line);
+		bytes = hist->alloc->realloc(hist->alloc->user, hist->bytes,
+				hist->bytes_allocated, allocated);
+	if (bytes == NULL)
+		return -1;
+	hist->bytes = bytes;
+	delta = allocated - hist->bytes_allocated;
+	head = hist->size > 0 ? hist->lines[history_slot(hist, 0)].offset : 0;
+	if (hist->size > 0 && history_tail(hist) <= head) {
+		/* Keep the oldest strings at the end, so the new room is in the
+		 * middle */
+		memmove(bytes + head + delta, bytes + head,
+				hist->bytes_allocated - head);
+		for (i = 0; i < hist->slots; ++i)
+			if (hist->lines[i].offset >= head)
+				hist->lines[i].offset += delta;
+	}
+	hist->bytes_allocated = allocated;
+	return 0;
+}
+
+int ll_history_push(struct ll_history *hist, const char *line)
+{
+	return history_push(hist, line, strlen(line));
+}
+
+static int history_blank(const char *line, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len && isspace((unsigned char)line[i]); ++i)
+		continue;
+	return i == len;
+}
+
+static size_t history_line_len(const char *line, const char *end)
+{
+	const char *nul = memchr(line, 0, end - line);
+
+	return (nul != NULL ? nul : end) - line;
+}
+
+static int history_push(struct ll_history *hist, const char *line,
+		size_t len)
+{
+	size_t where;
+	size_t copy;
+
+	if (hist->allocated == 0 || history_blank(line, len))
+		return -1;
+	if (hist->size > 0 && ll_history_len(hist, hist->size - 1) == len
+			&& memcmp(ll_history_index(hist, hist->size - 1), line,
+				len) == 0)
+		return -1;
+	if (hist->held != NULL
+			&& (copy = history_copy(hist, line, len)) != (size_t)-1)
+		history_erase(hist, copy);
+	++len;
+	if (hist->size == hist->allocated)
+		history_drop(hist);
+	if (hist->size + hist->erased == hist->slots)
+		history_compact(hist);
+	/* Make room, growing the buffer if possible, or else taking back the
+	 * room of the erased strings, or dropping the oldest ones */
+	while ((where = history_room(hist, len)) == (size_t)-1) {
+		if (history_grow(hist, len) == 0)
+			continue;
+		if (hist->erased > 0)
+			history_compact(hist);
+		else if (hist->size == 0)
+			return -1;
+		else
+			history_drop(hist);
+	}
+	memcpy(hist->bytes + where, line, len - 1);
+	hist->bytes[where + len - 1] = 0;
+	hist->lines[hist->end].offset = where;
+	hist->lines[hist->end].len = len - 1;
+	held_add(hist, hist->end, 1);
+	++hist->size;
 	++hist->end;
-	if (hist->end == hist->allocated)
+	if (hist->end == hist->slots)
 		hist->end = 0;
+	history_index(hist, hist->next_id++, line, len - 1);
+	return 0;
 }
 
 const char *ll_history_index(struct ll_history *hist, size_t index)
 {
-	if (hist->size < hist->allocated)
-		return hist->data[index];
-	return hist->data[(hist->end + index) % hist->allocated];
+	return hist->bytes + hist->lines[history_find(hist, index)].offset;
+}
+
+size_t ll_history_len(struct ll_history *hist, size_t index)
+{
+	return hist->lines[history_find(hist, index)].len;
+}
+
+int ll_history_search(struct ll_history *hist, const char *str,
+		size_t *index)
+{
+	const struct ll_history_bucket *rarest = NULL;
+	const struct ll_history_bucket *bucket;
+	const struct ll_history_line *line;
+	size_t len = strlen(str);
+	size_t i;
+	size_t at;
+
+	/* Only the strings in the bucket of each of its trigrams may hold str:
+	 * go through the ones in the smallest bucket, or else through all */
+	for (i = 0; hist->trigrams.buckets != NULL && i + 3 <= len; ++i) {
+		bucket = index_bucket(&hist->trigrams, trigram_hash(str + i));
+		if (rarest == NULL
+				|| bucket->len - bucket->begin
+				< rarest->len - rarest->begin)
+			rarest = bucket;
+	}
+	for (i = bucket_find(hist, rarest, history_position(hist, *index));
+			i > (rarest != NULL ? rarest->begin : 0);) {
+		at = bucket_at(hist, rarest, --i);
+		line = history_at(hist, at);
+		if (!history_erased(hist, history_slot(hist, at))
+				&& strstr(hist->bytes + line->offset,
+					str) != NULL) {
+			*index = history_rank(hist, at);
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static int starts_with(struct ll_history *hist, size_t pos,
+		const char *prefix, size_t len)
+{
+	const struct ll_history_line *line = history_at(hist, pos);
+
+	return !history_erased(hist, history_slot(hist, pos))
+		&& line->len >= len
+		&& memcmp(hist->bytes + line->offset, prefix, len) == 0;
+}
+
+static int search_prefix(struct ll_history *hist, const char *prefix,
+		size_t len, size_t *index, int older)
+{
+	const struct ll_history_bucket *bucket = NULL;
+	uint32_t hash = LL_PREFIX_HASH;
+	size_t begin = 0;
+	size_t end = hist->size + hist->erased;
+	size_t n;
+	size_t i;
+	size_t at;
+
+	/* Only the strings in the bucket of the longest beginning of the
+	 * prefix that is hashed may start with it */
+	if (hist->prefixes.buckets != NULL && len > 0) {
+		for (n = len; !prefix_hashed(n); --n)
+			continue;
+		for (i = 0; i < n; ++i)
+			hash = prefix_hash(hash, prefix[i]);
+		bucket = index_bucket(&hist->prefixes, hash);
+		begin = bucket->begin;
+		end = bucket->len;
+	}
+	if (older) {
+		for (i = bucket_find(hist, bucket,
+					history_position(hist, *index));
+				i-- > begin;) {
+			at = bucket_at(hist, bucket, i);
+			if (starts_with(hist, at, prefix, len)) {
+				*index = history_rank(hist, at);
+				return 0;
+			}
+		}
+	} else {
+		for (i = bucket_find(hist, bucket,
+					history_position(hist, *index + 1));
+				i < end; ++i) {
+			at = bucket_at(hist, bucket, i);
+			if (starts_with(hist, at, prefix, len)) {
+				*index = history_rank(hist, at);
+				return 0;
+			}
+		}
+	}
+	return -1;
+}
+
+int ll_history_search_prefix(struct ll_history *hist, const char *prefix,
+		size_t len, size_t *index)
+{
+	return search_prefix(hist, prefix, len, index, 1);
+}
+
+int ll_history_search_prefix_forward(struct ll_history *hist,
+		const char *prefix, size_t len, size_t *index)
+{
+	return search_prefix(hist, prefix, len, index, 0);
+}
+
+void ll_history_erase_dups(struct ll_history *hist, int enable)
+{
+	const struct ll_allocator *alloc = hist->alloc;
+	size_t copy;
+	size_t i;
+
+	if (!enable) {
+		if (hist->erased > 0)
+			history_compact(hist);
+		alloc->free(alloc->user, hist->held,
+				hist->slots * sizeof(*hist->held));
+		hist->held = NULL;
+		index_free(hist, &hist->strings);
+		hist->erase_dups = 0;
+		return;
+	}
+	if (hist->erase_dups)
+		return;
+	hist->erase_dups = 1;
+	if (hist->allocated == 0)
+		return;
+	/* Leave as many slots again for erased strings, so that they are only
+	 * compacted once there are that many of them */
+	if (hist->slots == hist->allocated)
+		history_reslot(hist, 2 * hist->allocated);
+	hist->held = alloc->malloc(alloc->user,
+			hist->slots * sizeof(*hist->held));
+	if (hist->held == NULL)
+		return;
+	memset(hist->held, 0, hist->slots * sizeof(*hist->held));
+	for (i = 0; i < hist->size; ++i)
+		held_add(hist, history_slot(hist, i), 1);
+	index_init(hist, &hist->strings);
+	for (i = 0; hist->strings.buckets != NULL && i < hist->size; ++i)
+		if (index_add(hist, &hist->strings,
+					string_hash(ll_history_index(hist, i),
+						ll_history_len(hist, i)),
+					hist->next_id - hist->size + i) != 0)
+			index_free(hist, &hist->strings);
+	/* Keep the newest copy of every string; erasing strings leaves the
+	 * positions of the ones before them as they were */
+	for (i = hist->size; i-- > 0;) {
+		copy = history_copy(hist, ll_history_index(hist, i),
+				ll_history_len(hist, i));
+		if (copy != i)
+			history_erase(hist, i);
+	}
+}
+
+static const char *history_window(const struct ll_history *hist,
+		const char *data, const char *end)
+{
+	const struct ll_allocator *alloc = hist->alloc;
+	struct file_line *seen = NULL;
+	const char *newest = NULL;
+	const char *line;
+	size_t newest_len = 0;
+	size_t count = 0;
+	size_t size = 1;
+	size_t len;
+	int kept;
+
+	/* Erasing duplicates, a line is only kept the first time it is seen;
+	 * without memory to tell, the whole file is read */
+	if (hist->held != NULL) {
+		while (size < 2 * hist->allocated)
+			size *= 2;
+		seen = alloc->malloc(alloc->user, size * sizeof(*seen));
+		if (seen == NULL)
+			return data;
+		memset(seen, 0, size * sizeof(*seen));
+	}
+	/* Count the lines that would be kept, the way history_push() does,
+	 * from the newest one back */
+	while (end > data && count < hist->allocated) {
+		for (line = end - 1; line > data && line[-1] != '\n'; --line)
+			continue;
+		len = history_line_len(line, end - 1);
+		if (history_blank(line, len))
+			kept = 0;
+		else if (seen != NULL)
+			kept = window_add(seen, size, line, len);
+		else
+			kept = newest == NULL || len != newest_len
+				|| memcmp(line, newest, len) != 0;
+		if (kept) {
+			newest = line;
+			newest_len = len;
+			++count;
+		}
+		end = line;
+	}
+	if (seen != NULL)
+		alloc->free(alloc->user, seen, size * sizeof(*seen));
+	/* Older copies of the oldest line kept are left out too */
+	return newest != NULL ? newest : end;
+}
+
+static int window_add(struct file_line *seen, size_t size, const char *line,
+		size_t len)
+{
+	size_t i = string_hash(line, len) & (size - 1);
+
+	/* There are always more slots than lines kept */
+	for (; seen[i].str != NULL; i = (i + 1) & (size - 1))
+		if (seen[i].len == len && memcmp(seen[i].str, line, len) == 0)
+			return 0;
+	seen[i].str = line;
+	seen[i].len = len;
+	return 1;
 }
 
 int ll_history_read(struct ll_history *hist, const char *path)
 {
-	FILE *f;
-	int c;
+	struct stat st;
 	struct ll_buf buf;
+	char chunk[LL_HISTORY_READ_SIZE];
+	const char *data = MAP_FAILED;
+	ssize_t n;
+	int fd;
 
-	f = fopen(path, "r");
-	if (f == NULL) {
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) != 0) {
 		perror(path);
+		if (fd >= 0)
+			close(fd);
 		return -1;
 	}
 	ll_history_clear(hist);
-	ll_buf_init(&buf);
-	while ((c = fgetc(f)) != EOF) {
-		if (c == '\n') {
-			if (buf.len > 0) {
-				ll_history_push(hist, buf.str);
-				ll_buf_assign(&buf, "", 0);
-			}
-		} else {
-			ll_buf_append_char(&buf, c);
-		}
+	hist->file_lines = 0;
+	/* Map a whole regular file, so that only the pages looked at are
+	 * read */
+	if (S_ISREG(st.st_mode) && st.st_size > 0)
+		data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data != MAP_FAILED) {
+		close(fd);
+		history_load(hist, data, st.st_size);
+		munmap((void *)data, st.st_size);
+		return 0;
 	}
+	/* Anything else, e.g. a pipe, is read to the end */
+	ll_buf_init_alloc(&buf, hist->alloc);
+	do {
+		n = read(fd, chunk, sizeof(chunk));
+		if (n > 0)
+			ll_buf_append(&buf, chunk, n);
+	} while (n > 0 || (n < 0 && errno == EINTR));
+	close(fd);
+	if (n < 0)
+		perror(path);
+	else
+		history_load(hist, buf.str, buf.len);
 	ll_buf_deinit(&buf);
-	fclose(f);
+	return n < 0 ? -1 : 0;
+}
+
+static void history_load(struct ll_history *hist, const char *data,
+		size_t size)
+{
+	const char *line;
+	const char *end;
+	const char *first;
+	const char *last;
+
+	if (size == 0)
+		return;
+	/* Leave out an unfinished last line, then find where the lines that
+	 * fit in the history start, and go through them a line at a time */
+	for (last = data + size; last > data && last[-1] != '\n'; --last)
+		continue;
+	first = history_window(hist, data, last);
+	for (line = first; line < last; line = end + 1) {
+		end = memchr(line, '\n', last - line);
+		if (end > line) {
+			history_push(hist, line, history_line_len(line, end));
+			++hist->file_lines;
+		}
+	}
+	/* Count the lines before those only as far as it matters for
+	 * writing the file again */
+	for (end = first; end > data
+			&& hist->file_lines < 2 * hist->allocated; end = line) {
+		for (line = end - 1; line > data && line[-1] != '\n'; --line)
+			continue;
+		if (end - 1 > line)
+			++hist->file_lines;
+	}
+	/* Lines can't be appended after an unfinished one: write the whole
+	 * file again next time */
+	if (data[size - 1] != '\n')
+		hist->file_lines = 2 * hist->allocated;
+}
+
+static int write_all(int fd, const char *str, size_t len)
+{
+	ssize_t written;
+
+	while (len > 0) {
+		written = write(fd, str, len);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		str += written;
+		len -= written;
+	}
 	return 0;
 }
 
 int ll_history_write(struct ll_history *hist, const char *path)
 {
-	FILE *f;
-	int i;
+	char buf[LL_HISTORY_WRITE_SIZE];
+	size_t used = 0;
+	size_t tmp_len = strlen(path) + sizeof(".tmp");
+	char *tmp;
+	const char *line;
+	size_t len;
+	int retval = 0;
+	int fd;
+	size_t i;
 
-	f = fopen(path, "w");
-	if (f == NULL) {
+	/* Write to a file of its own, so the old one stays if anything fails */
+	tmp = hist->alloc->malloc(hist->alloc->user, tmp_len);
+	if (tmp == NULL)
+		return -1;
+	strcpy(tmp, path);
+	strcat(tmp, ".tmp");
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0) {
+		perror(tmp);
+		hist->alloc->free(hist->alloc->user, tmp, tmp_len);
+		return -1;
+	}
+	for (i = 0; i < hist->size && retval == 0; ++i) {
+		line = ll_history_index(hist, i);
+		len = ll_history_len(hist, i);
+		if (used + len + 1 > sizeof(buf)) {
+			retval = write_all(fd, buf, used);
+			used = 0;
+		}
+		if (len + 1 > sizeof(buf)) {
+			if (retval == 0)
+				retval = write_all(fd, line, len);
+			if (retval == 0)
+				retval = write_all(fd, "\n", 1);
+			continue;
+		}
+		memcpy(buf + used, line, len);
+		buf[used + len] = '\n';
+		used += len + 1;
+	}
+	if (retval == 0)
+		retval = write_all(fd, buf, used);
+	if (retval == 0)
+		retval = fsync(fd);
+	if (close(fd) != 0)
+		retval = -1;
+	if (retval == 0)
+		retval = rename(tmp, path);
+	if (retval != 0) {
+		perror(path);
+		unlink(tmp);
+	} else {
+		hist->file_lines = hist->size;
+	}
+	hist->alloc->free(hist->alloc->user, tmp, tmp_len);
+	return retval;
+}
+
+int ll_history_append(struct ll_history *hist, const char *path)
+{
+	struct iovec iov[2];
+	const char *line;
+	size_t len;
+	ssize_t written;
+	int fd;
+
+	if (hist->size == 0)
+		return 0;
+	if (hist->file_lines >= 2 * hist->allocated)
+		return ll_history_write(hist, path);
+	fd = open(path, O_WRONLY | O_APPEND | O_CREAT, 0666);
+	if (fd < 0) {
 		perror(path);
 		return -1;
 	}
-	for (i = 0; i < hist->size; ++i)
-		fprintf(f, "%s\n", ll_history_index(hist, i));
-	fclose(f);
+	/* The line and its end go in a single write, so that lines appended
+	 * at the same time by others don't get mixed with it */
+	line = ll_history_index(hist, hist->size - 1);
+	len = ll_history_len(hist, hist->size - 1);
+	iov[0].iov_base = (char *)line;
+	iov[0].iov_len = len;
+	iov[1].iov_base = "\n";
+	iov[1].iov_len = 1;
+	do
+		written = writev(fd, iov, 2);
+	while (written < 0 && errno == EINTR);
+	/* Finish a short write with whatever was left out */
+	if (written >= 0 && (size_t)written < len
+			&& write_all(fd, line + written, len - written) != 0)
+		written = -1;
+	if (written >= 0 && (size_t)written <= len
+			&& write_all(fd, "\n", 1) != 0)
+		written = -1;
+	if (written < 0) {
+		perror(path);
+		close(fd);
+		return -1;
+	}
+	close(fd);
+	++hist->file_lines;
 	return 0;
 }
-
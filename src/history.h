@@ -3,35 +3,138 @@
 #ifndef LITTLELINE_HISTORY_H_
 #define LITTLELINE_HISTORY_H_
 
+#include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
 
+#include "alloc.h"
+
 /**
  * History
  * -------
  *
  * The history of the command line, implemented as a fixed-size circular list
- * of strings.
+ * of strings. The strings themselves are kept one after another in a circular
+ * buffer of bytes, which grows as long as there is memory for it; once it
+ * can't, the oldest strings make room for the new ones. Dropping the oldest
+ * string only moves the start of the list, and going through all of them
+ * walks the buffer from one end to the other.
+ *
+ * To search the strings quickly, every sequence of three bytes found in them
+ * is hashed into a bucket listing the strings that hold it; only the strings
+ * listed in the rarest bucket of what is looked for need to be checked. In
+ * the same way, the beginnings of a string up to 8 bytes long, and then the
+ * ones 16, 32 and so on up to ``LL_HISTORY_PREFIX`` bytes long, are hashed
+ * into buckets listing the strings that start with them.
+ *
+ * Pushing a string already held can erase the older copy instead, so that the
+ * same few strings don't push all the others out. Erased strings are only
+ * marked as such, and skipped when counting through the strings; their room
+ * is taken back once they are the oldest ones, or all at once when too many
+ * of them pile up.
+ */
+
+/**
+ * Maximum number of buckets of each index of a history; fewer are used for
+ * shorter histories
+ */
+#ifndef LL_HISTORY_BUCKETS
+#define LL_HISTORY_BUCKETS 65536
+#endif
+
+/**
+ * Number of bytes at the beginning of the strings that they can be found by
+ * directly; other prefixes are looked for among the strings starting with
+ * the longest of their beginnings that is hashed
  */
+#ifndef LL_HISTORY_PREFIX
+#define LL_HISTORY_PREFIX 64
+#endif
+
+/**
+ * Where a string is in the buffer of a history
+ */
+struct ll_history_line {
+	/* Offset of its first byte */
+	size_t offset;
+	/* Number of bytes, not counting the NUL character after them */
+	size_t len;
+};
+
+/**
+ * Strings having one of the parts hashed to a bucket
+ */
+struct ll_history_bucket {
+	/* Ids of the strings, oldest first; the ones before begin are gone */
+	uint32_t *ids;
+	/* Index of the first id and after the last one */
+	size_t begin;
+	size_t len;
+	/* Number of ids allocated */
+	size_t allocated;
+};
+
+/**
+ * Strings by the hashes of some of their parts
+ */
+struct ll_history_index {
+	/* Buckets, or NULL if there is no memory for them */
+	struct ll_history_bucket *buckets;
+	/* Number of buckets, a power of 2 */
+	size_t size;
+};
 
 /**
  * Fixed-size circular list to store text strings 
  */
 struct ll_history {
-	/* All strings stored here */
-	char **data;
+	/* All strings stored here, each terminated by a NUL character and never
+	 * split across the end of the buffer */
+	char *bytes;
+	/* Size of bytes */
+	size_t bytes_allocated;
+	/* Where each string is in bytes */
+	struct ll_history_line *lines;
 	/* Total capacity */
 	size_t allocated;
+	/* Number of elements of lines, which may be more than allocated to make
+	 * room for erased strings */
+	size_t slots;
 	/* Number of strings currently held */
 	size_t size;
+	/* Number of erased strings still in lines, all of them newer than the
+	 * oldest string held */
+	size_t erased;
 	/* Index of the element after the last one */
 	size_t end;
+	/* Number of lines in the file last read or written */
+	size_t file_lines;
+	/* Id of the next string pushed, which tells it apart from the others */
+	uint32_t next_id;
+	/* Set to erase the older copy of a string pushed again */
+	int erase_dups;
+	/* Number of strings held in ranges of lines, as a Fenwick tree, to
+	 * tell the erased ones and skip them; NULL unless erase_dups is set,
+	 * and then duplicates are kept if there is no memory for it */
+	uint32_t *held;
+	/* Strings by the trigrams they hold, by their beginnings, and by the
+	 * whole of them while erase_dups is set */
+	struct ll_history_index trigrams;
+	struct ll_history_index prefixes;
+	struct ll_history_index strings;
+	/* Where the memory for the strings comes from */
+	const struct ll_allocator *alloc;
 };
 
 /**
  * Initialize history
  */
 void ll_history_init(struct ll_history *hist, size_t max_lines);
+/**
+ * Same as ``ll_history_init()``, taking memory from ``alloc``
+ */
+void ll_history_init_alloc(struct ll_history *hist, size_t max_lines,
+		const struct ll_allocator *alloc);
 /**
  * Destroy history
  */
@@ -42,21 +145,60 @@ void ll_history_deinit(struct ll_history *hist);
 void ll_history_clear(struct ll_history *hist);
 /**
  * Push a copy of ``line`` into ``hist``; if ``size`` reaches ``allocated``,
- * it will push out the oldest stored string.
+ * or there is no memory left for it, it will push out the oldest stored
+ * strings. Return -1 if ``line`` was left out, because it is blank, the same
+ * as the last one, or too long to fit.
  */
-void ll_history_push(struct ll_history *hist, const char *line);
+int ll_history_push(struct ll_history *hist, const char *line);
 /**
  * Return the string whose ``index`` is given, counting from the oldest one
  * still stored in the list. 
  */
 const char *ll_history_index(struct ll_history *hist, size_t index);
 /**
- * Read the history from a file 
+ * Return the length of the string whose ``index`` is given
+ */
+size_t ll_history_len(struct ll_history *hist, size_t index);
+/**
+ * Look for ``str`` in the strings before the one whose index is ``*index``,
+ * from the newest back; if one holds it, set ``*index`` to its index and
+ * return 0, or else return -1
+ */
+int ll_history_search(struct ll_history *hist, const char *str,
+		size_t *index);
+/**
+ * Look for a string starting with the ``len`` bytes of ``prefix`` before the
+ * one whose index is ``*index``, from the newest back; if there is one, set
+ * ``*index`` to its index and return 0, or else return -1
+ */
+int ll_history_search_prefix(struct ll_history *hist, const char *prefix,
+		size_t len, size_t *index);
+/**
+ * Same as ``ll_history_search_prefix()``, looking after the string whose
+ * index is ``*index``, from the oldest on
+ */
+int ll_history_search_prefix_forward(struct ll_history *hist,
+		const char *prefix, size_t len, size_t *index);
+/**
+ * If ``enable`` is set, make pushing a string that is already held erase the
+ * older copy of it, so that every string is held only once; older copies of
+ * the strings held already are erased right away
+ */
+void ll_history_erase_dups(struct ll_history *hist, int enable);
+/**
+ * Read the history from a file; only its last lines, as many as the history
+ * keeps, are looked at
  */
 int ll_history_read(struct ll_history *hist, const char *path);
 /**
- * Write the history to a file 
+ * Write the history to a file, replacing it only once it is complete
  */
 int ll_history_write(struct ll_history *hist, const char *path);
+/**
+ * Add the newest string of the history at the end of a file; once the file
+ * holds twice as many lines as the history, write it again with just the
+ * ones in the history instead
+ */
+int ll_history_append(struct ll_history *hist, const char *path);
 
 #endif
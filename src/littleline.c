@@ -3,11 +3,14 @@
 #include "littleline.h"
 
 #include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 #if (defined(__unix__) || defined(unix))
 #include <termios.h>
+#include <poll.h>
 #include <stdlib.h>
 #elif (defined(_WIN32) || defined(WIN32))
 #include <conio.h>
@@ -15,45 +18,161 @@
 #endif
 
 #include "buffer.h"
+#include "display.h"
+#include "gap.h"
 #include "history.h"
 
+/* Milliseconds to wait for the rest of a key sequence before taking what has
+ * been typed as it is, e.g. to tell a lone Escape from the start of an ANSI
+ * sequence */
+#define LL_KEY_TIMEOUT 500
+/* Returned by keyboard_fill() if nothing was typed in time, and given to
+ * handle_key() to complete the sequence pending */
+#define LL_KEY_NONE (-2)
+/* Returned by commands that end the input */
+#define LL_END_OF_INPUT 2
+/* Longest key sequence handled */
+#define LL_KEY_MAX 32
+/* Size of the buffer for input read ahead */
+#define LL_INPUT_SIZE 4096
+/* Sent by the terminal around pasted text once bracketed paste is enabled */
+#define LL_PASTE_ENABLE "\x1B[?2004h"
+#define LL_PASTE_DISABLE "\x1B[?2004l"
+#define LL_PASTE_BEGIN "\x1B[200~"
+#define LL_PASTE_END "\x1B[201~"
+/* Bytes of static memory for the default context to take everything from
+ * instead of the heap; 0 makes it use the heap */
+#ifndef LL_MEMORY_SIZE
+#define LL_MEMORY_SIZE 0
+#endif
+/* Percentage of the memory given to a context that is kept for its history */
+#ifndef LL_HISTORY_SHARE
+#define LL_HISTORY_SHARE 50
+#endif
+
+/* What the characters typed are taken as */
+enum {
+	/* Keys, looked up in the bindings */
+	LL_MODE_KEYS,
+	/* A single character to insert as it is */
+	LL_MODE_VERBATIM,
+	/* Pasted text, inserted as it is once the paste ends */
+	LL_MODE_PASTE
+};
+
 struct ll_context {
-	/* 0 if not yet initialized */
+	/* Where the context comes from, or NULL if it was put in a block */
+	const struct ll_allocator *alloc;
+	/* If it was, where everything else comes from, with a part of the block
+	 * set apart for the history */
+	struct ll_arena arena;
+	struct ll_arena history_arena;
+	/* How much memory went to each part */
+	struct ll_counter memory[LL_ALLOC_KINDS];
+	/* 0 if the terminal has not been set up yet */
 	int initialized;
+	/* File descriptors to read keys from and to print the line to */
+	int in;
+	int out;
+	/* Set if the output is a terminal, which is told about pastes */
+	int paste_enabled;
 #if (defined(__unix__) || defined(unix))
+	/* Set if the input is a terminal put in raw mode */
+	int raw;
 	/* Keep here a copy of the original state of the terminal */
 	struct termios buffered;
 	/* And build a new state here */
 	struct termios unbuffered;
 #endif
+	/* Input read but not handled yet */
+	unsigned char input[LL_INPUT_SIZE];
+	/* Index of the next character to handle, and after the last one read */
+	size_t input_begin;
+	size_t input_end;
+	/* What the next characters are taken as */
+	int mode;
+	/* Key sequence typed so far, while it may still match a binding */
+	char keys[LL_KEY_MAX];
+	size_t keys_len;
+	/* Number of characters of the end of a paste found so far */
+	size_t paste_matched;
+	/* Called when a line is accepted, if input is fed with ll_feed() */
+	void (*on_line) (struct ll_context *, const char *);
+	/* Set while a line is shown for editing */
+	int editing;
 	/* Key bindings */
 	struct ll_fsm bindings;
 	/* Last command executed */
-	int (*last_command) (void);
+	int (*last_command) (struct ll_context *);
 	/* All written lines */
 	struct ll_history history;
+	/* Set to keep only the newest copy of every line in the history */
+	int erase_dups;
 	/* To store executed lines */
         char *history_file;
 	/* Index of the line currently being viewed */
 	int focus;
 	/* Index of the character in line where the cursor currently is */
 	int cursor;
-	/* Index of the character in the printed line where the cursor currently
-	 * is; this may be different from cursor if there are non-printable
-	 * characters in the buffer */
-	int fmt_cursor;
-	/* Number of actual characters currently printed in the line */
-	int fmt_len;
-	/* Current line */
+	/* Line from the history being viewed, or NULL if it's the one in the
+	 * buffer */
 	const char *current;
+	/* Scroll long lines horizontally instead of wrapping them */
+	int hscroll;
+	/* Walk through the history only by the lines starting with the text
+	 * before the cursor */
+	int prefix_search;
+	/* Show after the line being edited, dimmed, the rest of the newest line
+	 * of the history that starts with it */
+	int autosuggest;
+	/* Text the suggestion was last looked up for, if suggest_valid is set;
+	 * index of the line found, or the size of the history if none was; and
+	 * number of bytes of it shown after the text */
+	int suggest_valid;
+	struct ll_buf suggest_for;
+	size_t suggest_index;
+	size_t suggest_len;
+	/* Set while searching the history for search, with search_prompt shown
+	 * instead of the prompt */
+	int searching;
+	struct ll_buf search;
+	struct ll_buf search_prompt;
+	/* Set if the last search found nothing */
+	int search_failed;
+	/* Where the match is in the line being viewed, and its length */
+	size_t search_match;
+	size_t search_match_len;
+	/* Line viewed and position of the cursor when the search began */
+	int search_focus;
+	int search_cursor;
+	/* Line as it was last printed, and whether it has been edited since */
+	const char *drawn;
+	int dirty;
+	/* Prompt for the line being edited */
+	struct ll_buf prompt;
 	/* Buffer for line editing */
-	struct ll_buf buffer;
+	struct ll_gap buffer;
 	/* A buffer to copy text */
 	struct ll_buf clipboard;
+	/* Text being pasted */
+	struct ll_buf paste;
+	/* What is printed on the terminal */
+	struct ll_display display;
 };
 
-/* There can be only one! */
-static struct ll_context cl = { 0 };
+/* Context used by the functions that don't take one */
+static struct ll_context *ll_default_context = NULL;
+
+/* Allocator for new contexts */
+static const struct ll_allocator *ll_allocator = &ll_heap_allocator;
+
+#if LL_MEMORY_SIZE > 0
+/* Block the default context is put in */
+static char ll_memory[LL_MEMORY_SIZE];
+/* Fail to build if it can't even hold the context */
+typedef char ll_memory_holds_context[LL_MEMORY_SIZE
+	>= sizeof(struct ll_context) + LL_ARENA_UNIT ? 1 : -1];
+#endif
 
 struct ll_binding LL_ANSI_KEY_BINDINGS[] = {
 	{"\x01", ll_beginning_of_line},	/* C-a */
@@ -62,11 +181,13 @@ struct ll_binding LL_ANSI_KEY_BINDINGS[] = {
 	{"\x04", ll_end_of_file},	/* C-d */
 	{"\x05", ll_end_of_line},	/* C-e */
 	{"\x06", ll_forward_char},	/* C-f */
+	{"\x07", ll_abort},	/* C-g */
 	{"\x08", ll_backward_delete_char},	/* C-h */
 	{"\x0A", ll_accept_line},	/* C-j */
 	{"\x0B", ll_forward_kill_line},	/* C-k */
 	{"\x0E", ll_next_history},	/* C-n */
 	{"\x10", ll_previous_history},	/* C-p */
+	{"\x12", ll_reverse_search_history},	/* C-r */
 	{"\x15", ll_backward_kill_line},	/* C-u */
 	{"\x16", ll_verbatim},	/* C-v */
 	{"\x17", ll_backward_kill_word},	/* C-w */
@@ -83,505 +204,1246 @@ struct ll_binding LL_ANSI_KEY_BINDINGS[] = {
 	{"\x1B[7~", ll_beginning_of_line},	/* Home */
 	{"\x1B[8~", ll_end_of_line},	/* End */
 	{"\x7F", ll_backward_delete_char},	/* Backspace */
+	{LL_PASTE_BEGIN, ll_bracketed_paste},	/* Pasted text */
 
 	{NULL}
 };
 
 /* Setup keyboard */
-static int keyboard_init(void);
+static int keyboard_init(struct ll_context *ctx);
 /* Setdown keyboard */
-static void keyboard_deinit(void);
-/* Get next character */
-static int keyboard_get(void);
+static void keyboard_deinit(struct ll_context *ctx);
+/* Make sure there is input to handle, reading all that is available if
+ * needed and waiting for at most timeout milliseconds if it's not negative;
+ * return EOF at the end of input */
+static int keyboard_fill(struct ll_context *ctx, int timeout);
+/* Look up the suggestion for the line being edited, if one is shown */
+static void update_suggestion(struct ll_context *ctx);
+/* Insert the text suggested after the line; return -1 if there is none */
+static int accept_suggestion(struct ll_context *ctx);
 /* Reprint the current line */
-static void reprint_line(void);
-/* Handle a character or sequence of such */
-static int handle_character(void);
-/* Copy the current line to the buffer */
-static int pop_line(void);
+static void reprint_line(struct ll_context *ctx);
+/* Start editing an empty line */
+static void begin_line(struct ll_context *ctx);
+/* Leave the line being edited on the terminal and move after it */
+static void finish_line(struct ll_context *ctx);
+/* Set up the terminal if needed and start editing a line after prompt */
+static void start(struct ll_context *ctx, const char *prompt);
+/* Handle a character typed, or complete the key sequence pending if c is
+ * LL_KEY_NONE; return 1 once the line is accepted, or LL_END_OF_INPUT once
+ * the input ends */
+static int handle_key(struct ll_context *ctx, int c);
+/* Handle up to len bytes of input, stopping after the line is accepted, and
+ * return through used how many were taken */
+static int handle_input(struct ll_context *ctx, const unsigned char *bytes,
+		size_t len, size_t *used);
+/* Length of the line being viewed */
+static size_t line_len(struct ll_context *ctx);
+/* Character at position i of the line being viewed, or 0 past its end */
+static char char_at(struct ll_context *ctx, size_t i);
+/* The line being viewed as a string */
+static const char *line_str(struct ll_context *ctx);
+/* Copy the current line to the buffer so it can be edited */
+static int pop_line(struct ll_context *ctx);
 /* Push the line currently being edited to the log and create a new one */
-static int push_line(void);
+static int push_line(struct ll_context *ctx);
 /* Insert a string where the cursor is */
-static int insert_str(const char *str, size_t len);
+static int insert_str(struct ll_context *ctx, const char *str, size_t len);
 /* Insert a character where the cursor is */
-static int insert_char(int c);
+static int insert_char(struct ll_context *ctx, int c);
+/* View the line of the history whose index is focus, or the one being
+ * edited if it is the size of the history */
+static void view_line(struct ll_context *ctx, int focus);
+/* Show what is being searched for, and whether it was found */
+static void show_search(struct ll_context *ctx);
+/* Look for the text being searched for in the lines before the one whose
+ * index is before, and show the newest one that holds it */
+static int search_history(struct ll_context *ctx, size_t before);
+/* Handle the keys typed while searching, bound to func if it's not NULL;
+ * return -1 if they end the search and have to be handled as usual */
+static int search_key(struct ll_context *ctx,
+		int (*func) (struct ll_context *), const char *keys, size_t len);
+/* Stop searching, leaving the line found for editing */
+static void end_search(struct ll_context *ctx);
+/* Set up a cleared context, taking memory for the history from history and
+ * for everything else from alloc */
+static void context_init(struct ll_context *ctx,
+		const struct ll_allocator *alloc,
+		const struct ll_allocator *history);
+/* Get the context for the functions that don't take one, creating it the
+ * first time */
+static struct ll_context *default_context(void);
+/* Drop the history and make room for max_lines */
+static void set_history(struct ll_context *ctx, size_t max_lines);
+/* Keep a copy of the path of the history file, or forget it if NULL */
+static int set_history_file(struct ll_context *ctx, const char *path);
 
 #if (defined(__unix__) || defined(unix))
-static int keyboard_init(void)
+static int keyboard_init(struct ll_context *ctx)
 {
-	/* Disable buffering in stdin. */
-	tcgetattr(0, &cl.buffered);
+	/* Leave pipes, sockets and files alone */
+	if (!isatty(ctx->in))
+		return 0;
+	ctx->raw = 1;
+	/* Disable buffering in the input. */
+	tcgetattr(ctx->in, &ctx->buffered);
 	/* unbuffered is the same as buffered but */
-	cl.unbuffered = cl.buffered;
+	ctx->unbuffered = ctx->buffered;
 	/* disable "canonical" mode */
-	cl.unbuffered.c_lflag &= (~ICANON);
+	ctx->unbuffered.c_lflag &= (~ICANON);
 	/* don't echo the character */
-	cl.unbuffered.c_lflag &= (~ECHO);
+	ctx->unbuffered.c_lflag &= (~ECHO);
 	/* don't automatically handle ^C */
-	/*cl.unbuffered.c_lflag &= (~ISIG); */
-	/* timeout (tenths of a second) */
-	cl.unbuffered.c_cc[VTIME] = 1;
-	/* minimum number of characters */
-	cl.unbuffered.c_cc[VMIN] = 0;
-	tcsetattr(0, TCSANOW, &cl.unbuffered);
+	/*ctx->unbuffered.c_lflag &= (~ISIG); */
+	/* block until there is at least one character, with no timeout */
+	ctx->unbuffered.c_cc[VTIME] = 0;
+	ctx->unbuffered.c_cc[VMIN] = 1;
+	tcsetattr(ctx->in, TCSANOW, &ctx->unbuffered);
 	return 0;
 }
 
-static void keyboard_deinit(void)
+static void keyboard_deinit(struct ll_context *ctx)
 {
-	/* Restore stdin settings. */
-	tcsetattr(0, TCSANOW, &cl.buffered);
+	/* Restore input settings. */
+	if (ctx->raw)
+		tcsetattr(ctx->in, TCSANOW, &ctx->buffered);
+	ctx->raw = 0;
 }
 
-static int keyboard_get(void)
+static int keyboard_fill(struct ll_context *ctx, int timeout)
 {
-	int ch;
-	do {
-		ch = getchar();
-	} while (ch == EOF);
-	return ch;
+	struct pollfd pfd;
+	ssize_t n;
+
+	if (ctx->input_begin < ctx->input_end)
+		return 0;
+	/* Only wait with a timeout if asked to; otherwise just block */
+	if (timeout >= 0) {
+		pfd.fd = ctx->in;
+		pfd.events = POLLIN;
+		do
+			n = poll(&pfd, 1, timeout);
+		while (n < 0 && errno == EINTR);
+		if (n == 0)
+			return LL_KEY_NONE;
+	}
+	do
+		n = read(ctx->in, ctx->input, sizeof(ctx->input));
+	while (n < 0 && errno == EINTR);
+	if (n <= 0)
+		return EOF;
+	ctx->input_begin = 0;
+	ctx->input_end = n;
+	return 0;
 }
 #endif
 
-static void reprint_line(void)
+static void update_suggestion(struct ll_context *ctx)
 {
-	size_t old_fmt_len;
-	const char *it;
-	const char *end;
-	unsigned char c;
-	int i;
+	size_t len = ll_gap_len(&ctx->buffer);
+	size_t index = ctx->suggest_index;
+	size_t shown = ctx->suggest_len;
+	const char *line;
+	int extends;
 
-	/* We'll need this later */
-	old_fmt_len = cl.fmt_len;
-	/* Move the cursor to the beginning of the line */
-	for (i = 0; i < cl.fmt_cursor; ++i)
-		write(STDOUT_FILENO, "\b", 1);
-	/* Rebuild the formatted string */
-	cl.fmt_cursor = -1;
-	cl.fmt_len = 0;
-	end = cl.current + strlen(cl.current);
-	for (it = cl.current; *it;) {
-		if (it - cl.current == cl.cursor)
-			cl.fmt_cursor = cl.fmt_len;
-		c = *it;
-		if (c < 32) {
-			/* Handle special characters */
-			c += 64;
-			write(STDOUT_FILENO, "^", 1);
-			write(STDOUT_FILENO, &c, 1);
-			cl.fmt_len += 2;
-			++it;
-		} else if ((c & 0x80) == 0) {
-			/* Handle plain ASCII */
-			write(STDOUT_FILENO, &c, 1);
-			++cl.fmt_len;
-			++it;
-		} else if ((c & 0xE0) == 0xC0) {
-			/* Handle two-byte utf-8 sequence */
-			if (end - it < 2)
-				break;
-			write(STDOUT_FILENO, it, 2);
-			++cl.fmt_len;
-			it += 2;
-		} else if ((c & 0xF0) == 0xE0) {
-			/* Handle three-byte utf-8 sequence */
-			if (end - it < 3)
-				break;
-			write(STDOUT_FILENO, it, 3);
-			++cl.fmt_len;
-			it += 3;
-		} else if ((c & 0xF8) == 0xF0) {
-			/* Handle four-byte utf-8 sequence */
-			if (end - it < 4)
-				break;
-			write(STDOUT_FILENO, it, 4);
-			++cl.fmt_len;
-			it += 4;
-		} else if ((c & 0xFC) == 0xF8) {
-			/* Handle five-byte utf-8 sequence */
-			if (end - it < 5)
-				break;
-			write(STDOUT_FILENO, it, 5);
-			++cl.fmt_len;
-			it += 5;
-		} else {
-			/* Handle bad utf-8 sequence */
-			write(STDOUT_FILENO, "\\x", 2);
-			c = '0' + (*it >> 4);
-			write(STDOUT_FILENO, &c, 1);
-			c = '0' + (*it & 0xF);
-			write(STDOUT_FILENO, &c, 1);
-			cl.fmt_len += 4;
-			++it;
-		}
+	ctx->suggest_len = 0;
+	if (!ctx->autosuggest || !ctx->editing || ctx->searching
+			|| ctx->current != NULL || len == 0
+			|| (size_t)ctx->cursor != len) {
+		if (shown > 0)
+			ctx->dirty = 1;
+		return;
+	}
+	line = ll_gap_str(&ctx->buffer);
+	extends = ctx->suggest_valid && len >= ctx->suggest_for.len
+		&& memcmp(line, ctx->suggest_for.str,
+				ctx->suggest_for.len) == 0;
+	if (!extends || len > ctx->suggest_for.len) {
+		/* The lines newer than the one found for the text it starts
+		 * with do not start with it either, nor does any if none did */
+		if (!extends)
+			index = ctx->history.size;
+		else if (index < ctx->history.size)
+			++index;
+		else
+			index = 0;
+		if (index == 0 || ll_history_search_prefix(&ctx->history, line,
+					len, &index) != 0)
+			index = ctx->history.size;
+		ll_buf_assign(&ctx->suggest_for, line, len);
+		ctx->suggest_valid = ctx->suggest_for.len == len;
 	}
-	/* If the cursor index is still -1, that means it is actually after the end
-	 * of the formatted line */
-	if (cl.fmt_cursor < 0)
-		cl.fmt_cursor = cl.fmt_len;
-	/* If the old fmt_len was greater than the current, that means we have
-	 * deleted some characters: overwrite them with spaces */
-	i = cl.fmt_len;
-	while (i < old_fmt_len) {
-		write(STDOUT_FILENO, " ", 1);
-		++i;
+	if (index < ctx->history.size)
+		ctx->suggest_len = ll_history_len(&ctx->history, index) - len;
+	if (index != ctx->suggest_index || ctx->suggest_len != shown)
+		ctx->dirty = 1;
+	ctx->suggest_index = index;
+}
+
+static int accept_suggestion(struct ll_context *ctx)
+{
+	size_t len = ll_gap_len(&ctx->buffer);
+
+	update_suggestion(ctx);
+	if (ctx->suggest_len == 0)
+		return -1;
+	return insert_str(ctx, ll_history_index(&ctx->history,
+				ctx->suggest_index) + len, ctx->suggest_len);
+}
+
+static void reprint_line(struct ll_context *ctx)
+{
+	const char *prompt = ctx->prompt.str;
+	size_t len;
+
+	/* While searching, the match is highlighted, and otherwise the
+	 * suggestion is dimmed */
+	ctx->display.mark_begin = 0;
+	ctx->display.mark_end = 0;
+	ctx->display.mark_dim = 0;
+	update_suggestion(ctx);
+	if (ctx->searching) {
+		prompt = ctx->search_prompt.str;
+		ctx->display.mark_begin = ctx->search_match;
+		ctx->display.mark_end = ctx->search_match + ctx->search_match_len;
 	}
-	/* Move back the cursor from the end of the printed line to the actual
-	 * cursor position */
-	while (i > cl.fmt_cursor) {
-		write(STDOUT_FILENO, "\b", 1);
-		--i;
+	/* If only the cursor moved, there is no need to format the line again */
+	if (ctx->dirty || ctx->current != ctx->drawn
+			|| ll_display_move(&ctx->display, ctx->cursor) != 0) {
+		/* The buffer is drawn from both sides of its gap as they are */
+		if (ctx->current != NULL) {
+			ll_display_render(&ctx->display, prompt, ctx->current,
+					ll_history_len(&ctx->history, ctx->focus),
+					ctx->cursor);
+		} else if (ctx->suggest_len > 0) {
+			len = ll_gap_len(&ctx->buffer);
+			ctx->display.mark_begin = len;
+			ctx->display.mark_end = len + ctx->suggest_len;
+			ctx->display.mark_dim = 1;
+			ll_display_render_split(&ctx->display, prompt,
+					ll_gap_str(&ctx->buffer), len,
+					ll_history_index(&ctx->history,
+						ctx->suggest_index) + len,
+					ctx->suggest_len, ctx->cursor);
+		} else {
+			ll_display_render_split(&ctx->display, prompt,
+					ctx->buffer.str, ctx->buffer.begin,
+					ctx->buffer.str + ctx->buffer.end,
+					ctx->buffer.allocated - ctx->buffer.end,
+					ctx->cursor);
+		}
 	}
+	ctx->drawn = ctx->current;
+	ctx->dirty = 0;
+	ll_display_flush(&ctx->display);
 }
 
-static int pop_line(void)
+static size_t line_len(struct ll_context *ctx)
 {
-	if (cl.current != cl.buffer.str) {
-		ll_buf_assign(&cl.buffer, cl.current, strlen(cl.current));
-		cl.current = cl.buffer.str;
-		cl.focus = cl.history.size;
+	if (ctx->current != NULL)
+		return ll_history_len(&ctx->history, ctx->focus);
+	return ll_gap_len(&ctx->buffer);
+}
+
+static char char_at(struct ll_context *ctx, size_t i)
+{
+	if (ctx->current != NULL)
+		return ctx->current[i];
+	return ll_gap_at(&ctx->buffer, i);
+}
+
+static const char *line_str(struct ll_context *ctx)
+{
+	if (ctx->current != NULL)
+		return ctx->current;
+	return ll_gap_str(&ctx->buffer);
+}
+
+static int pop_line(struct ll_context *ctx)
+{
+	ctx->dirty = 1;
+	if (ctx->current != NULL) {
+		ll_gap_assign(&ctx->buffer, ctx->current, line_len(ctx));
+		ctx->current = NULL;
+		ctx->focus = ctx->history.size;
 		return 1;
 	}
 	return 0;
 }
 
-static int push_line(void)
+static int push_line(struct ll_context *ctx)
 {
-	ll_history_push(&cl.history, cl.current);
-	if (cl.history_file)
-		ll_history_write(&cl.history, cl.history_file);
+	if (ll_history_push(&ctx->history, line_str(ctx)) == 0
+			&& ctx->history_file)
+		ll_history_append(&ctx->history, ctx->history_file);
 	return 0;
 }
 
-static int insert_str(const char *str, size_t len)
+static void view_line(struct ll_context *ctx, int focus)
+{
+	ctx->focus = focus;
+	if (ctx->focus == ctx->history.size)
+		ctx->current = NULL;
+	else
+		ctx->current = ll_history_index(&ctx->history, ctx->focus);
+}
+
+static void show_search(struct ll_context *ctx)
 {
-	pop_line();
-	ll_buf_insert(&cl.buffer, cl.cursor, str, len);
-	cl.current = cl.buffer.str;
-	cl.cursor += len;
+	static const char failed[] = "(failed ";
+	static const char label[] = "reverse-i-search)`";
+
+	if (ctx->search_failed)
+		ll_buf_assign(&ctx->search_prompt, failed, sizeof(failed) - 1);
+	else
+		ll_buf_assign(&ctx->search_prompt, "(", 1);
+	ll_buf_append(&ctx->search_prompt, label, sizeof(label) - 1);
+	ll_buf_append(&ctx->search_prompt, ctx->search.str, ctx->search.len);
+	ll_buf_append(&ctx->search_prompt, "': ", 3);
+	ctx->dirty = 1;
+}
+
+static int search_history(struct ll_context *ctx, size_t before)
+{
+	size_t index = before;
+
+	ctx->search_failed = 0;
+	if (ctx->search.len == 0) {
+		/* Nothing to look for: go back to where the search began */
+		view_line(ctx, ctx->search_focus);
+		ctx->cursor = ctx->search_cursor;
+		ctx->search_match_len = 0;
+	} else if (ll_history_search(&ctx->history, ctx->search.str,
+				&index) == 0) {
+		view_line(ctx, index);
+		ctx->search_match = strstr(ctx->current, ctx->search.str)
+			- ctx->current;
+		ctx->search_match_len = ctx->search.len;
+		ctx->cursor = ctx->search_match;
+	} else {
+		/* Keep showing the last match */
+		ctx->search_failed = 1;
+	}
+	show_search(ctx);
+	return ctx->search_failed ? -1 : 0;
+}
+
+static int search_key(struct ll_context *ctx,
+		int (*func) (struct ll_context *), const char *keys, size_t len)
+{
+	size_t here;
+	size_t n;
+
+	/* The line found is looked at again as the text gets longer, but
+	 * anything newer is looked at again when it gets shorter */
+	here = ctx->focus < ctx->history.size ? ctx->focus + 1 : ctx->focus;
+	if (func == ll_reverse_search_history) {
+		if (search_history(ctx, ctx->focus) != 0)
+			ll_display_putc(&ctx->display, 7);
+	} else if (func == ll_backward_delete_char) {
+		if (ctx->search.len == 0)
+			return 0;
+		/* Drop the last character, with all of its bytes */
+		n = ctx->search.len;
+		do
+			--n;
+		while (n > 0 && (ctx->search.str[n] & 0xC0) == 0x80);
+		ll_buf_truncate(&ctx->search, n);
+		search_history(ctx, ctx->search_focus + 1);
+	} else if (func == ll_abort) {
+		view_line(ctx, ctx->search_focus);
+		ctx->cursor = ctx->search_cursor;
+		end_search(ctx);
+	} else if (func == NULL && (unsigned char)keys[0] >= 32
+			&& keys[0] != 0x7F) {
+		ll_buf_append(&ctx->search, keys, len);
+		if (search_history(ctx, here) != 0)
+			ll_display_putc(&ctx->display, 7);
+	} else if (func == NULL) {
+		/* Other characters, such as a lone Escape, just end it */
+		end_search(ctx);
+	} else {
+		end_search(ctx);
+		return -1;
+	}
 	return 0;
 }
 
-static int insert_char(int c)
+static void end_search(struct ll_context *ctx)
 {
-	pop_line();
-	ll_buf_insert_char(&cl.buffer, cl.cursor, c);
-	cl.current = cl.buffer.str;
-	++cl.cursor;
+	ctx->searching = 0;
+	ctx->dirty = 1;
+}
+
+static int insert_str(struct ll_context *ctx, const char *str, size_t len)
+{
+	size_t before;
+
+	pop_line(ctx);
+	/* Only what fits is inserted */
+	before = ll_gap_len(&ctx->buffer);
+	ll_gap_insert(&ctx->buffer, ctx->cursor, str, len);
+	ctx->cursor += ll_gap_len(&ctx->buffer) - before;
 	return 0;
 }
 
-static int handle_character(void)
+static int insert_char(struct ll_context *ctx, int c)
+{
+	char ch = c;
+
+	return insert_str(ctx, &ch, 1);
+}
+
+static void begin_line(struct ll_context *ctx)
+{
+	ll_gap_assign(&ctx->buffer, "", 0);
+	ctx->current = NULL;
+	ctx->focus = ctx->history.size;
+	ctx->cursor = 0;
+	ctx->dirty = 1;
+	ctx->searching = 0;
+	ctx->suggest_valid = 0;
+	ctx->suggest_len = 0;
+	ctx->mode = LL_MODE_KEYS;
+	ctx->keys_len = 0;
+	ll_fsm_reset(&ctx->bindings);
+	ctx->display.hscroll = ctx->hscroll;
+	ll_display_reset(&ctx->display);
+	if (ctx->paste_enabled)
+		ll_display_put(&ctx->display, LL_PASTE_ENABLE,
+				sizeof(LL_PASTE_ENABLE) - 1);
+	ctx->editing = 1;
+}
+
+static void finish_line(struct ll_context *ctx)
+{
+	if (!ctx->editing)
+		return;
+	/* Leave the line as it is, without the suggestion */
+	ctx->editing = 0;
+	reprint_line(ctx);
+	ll_display_finish(&ctx->display);
+	if (ctx->paste_enabled)
+		ll_display_put(&ctx->display, LL_PASTE_DISABLE,
+				sizeof(LL_PASTE_DISABLE) - 1);
+	ll_display_flush(&ctx->display);
+}
+
+static void start(struct ll_context *ctx, const char *prompt)
+{
+	if (ctx->initialized == 0) {
+		ctx->initialized = 1;
+		keyboard_init(ctx);
+		ctx->paste_enabled = isatty(ctx->out);
+	}
+	ll_buf_assign(&ctx->prompt, prompt, strlen(prompt));
+	ll_buf_append_char(&ctx->prompt, ' ');
+	begin_line(ctx);
+}
+
+static int handle_key(struct ll_context *ctx, int c)
 {
-	char buf[8];
-	size_t len = 0;
+	static const char end[] = LL_PASTE_END;
+	int (*func) (struct ll_context *);
+	size_t len;
 	int retval;
-	int (*func) (void);
 
-	do {
-		buf[len] = keyboard_get();
-		retval = ll_fsm_feed(&cl.bindings, buf[len], &func);
-		++len;
-	} while (retval == LL_FSM_INNER_STATE);
+	if (ctx->mode == LL_MODE_VERBATIM) {
+		if (c == LL_KEY_NONE)
+			return 0;
+		ctx->mode = LL_MODE_KEYS;
+		return insert_char(ctx, c);
+	}
+
+	if (ctx->mode == LL_MODE_PASTE) {
+		if (c == LL_KEY_NONE)
+			return 0;
+		ll_buf_append_char(&ctx->paste, c);
+		if (c == end[ctx->paste_matched])
+			++ctx->paste_matched;
+		else
+			ctx->paste_matched = c == end[0];
+		if (ctx->paste_matched < sizeof(end) - 1)
+			return 0;
+		ll_buf_truncate(&ctx->paste, ctx->paste.len - ctx->paste_matched);
+		ctx->mode = LL_MODE_KEYS;
+		return insert_str(ctx, ctx->paste.str, ctx->paste.len);
+	}
+
+	if (c == LL_KEY_NONE) {
+		if (ctx->keys_len == 0)
+			return 0;
+		/* An incomplete sequence is taken as it is */
+		ll_fsm_reset(&ctx->bindings);
+		retval = LL_FSM_BAD_STATE;
+	} else {
+		ctx->keys[ctx->keys_len++] = c;
+		retval = ll_fsm_feed(&ctx->bindings, c, &func);
+		if (retval == LL_FSM_INNER_STATE) {
+			if (ctx->keys_len < sizeof(ctx->keys))
+				return 0;
+			ll_fsm_reset(&ctx->bindings);
+			retval = LL_FSM_BAD_STATE;
+		}
+	}
+	len = ctx->keys_len;
+	ctx->keys_len = 0;
+
+	if (ctx->searching && search_key(ctx,
+				retval == LL_FSM_FINAL_STATE ? func : NULL,
+				ctx->keys, len) == 0) {
+		ctx->last_command = NULL;
+		return 0;
+	}
 
 	if (retval == LL_FSM_FINAL_STATE) {
-		retval = func();
-		cl.last_command = func;
+		retval = func(ctx);
+		ctx->last_command = func;
 		if (retval < 0) {
-			putchar(7);
+			ll_display_putc(&ctx->display, 7);
 			return 0;
 		}
 		return retval;
 	}
-	insert_str(buf, len);
-	cl.last_command = NULL;
+	insert_str(ctx, ctx->keys, len);
+	ctx->last_command = NULL;
 	return 0;
 }
 
-int ll_set_history(size_t max_lines)
+static int handle_input(struct ll_context *ctx, const unsigned char *bytes,
+		size_t len, size_t *used)
+{
+	const unsigned char *esc;
+	size_t i = 0;
+	size_t n;
+	int retval = 0;
+
+	while (i < len && retval == 0) {
+		/* Take pasted text up to the next escape in one go */
+		if (ctx->mode == LL_MODE_PASTE && ctx->paste_matched == 0) {
+			esc = memchr(bytes + i, LL_PASTE_END[0], len - i);
+			n = esc != NULL ? esc - (bytes + i) : len - i;
+			ll_buf_append(&ctx->paste, bytes + i, n);
+			i += n;
+			if (esc == NULL)
+				break;
+		}
+		retval = handle_key(ctx, bytes[i++]);
+	}
+	*used = i;
+	return retval;
+}
+
+int ll_set_allocator(const struct ll_allocator *alloc)
 {
-	ll_history_init(&cl.history, max_lines);
-	cl.history_file = NULL;
+	ll_allocator = alloc != NULL ? alloc : &ll_heap_allocator;
 	return 0;
 }
 
-int ll_set_history_with_file(size_t max_lines, const char *path)
+struct ll_context *ll_context_new(void)
 {
-	ll_history_init(&cl.history, max_lines);
-	cl.history_file = strcpy(malloc(strlen(path) + 1), path);
-	return ll_history_read(&cl.history, path);
+	return ll_context_new_alloc(ll_allocator);
 }
 
-int ll_set_key_bindings(const struct ll_binding *bindings)
+struct ll_context *ll_context_new_alloc(const struct ll_allocator *alloc)
 {
-	ll_fsm_init(&cl.bindings, bindings);
+	struct ll_context *ctx;
+
+	ctx = alloc->malloc(alloc->user, sizeof(*ctx));
+	if (ctx == NULL)
+		return NULL;
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->alloc = alloc;
+	context_init(ctx, alloc, alloc);
+	return ctx;
+}
+
+struct ll_context *ll_context_new_fixed(void *block, size_t size)
+{
+	struct ll_context *ctx;
+	size_t skip;
+	size_t history;
+	char *rest;
+	int i;
+
+	/* The context goes first, and the rest is split in two arenas */
+	skip = (LL_ARENA_UNIT - (uintptr_t)block % LL_ARENA_UNIT)
+		% LL_ARENA_UNIT;
+	if (size < skip + sizeof(*ctx))
+		return NULL;
+	ctx = (struct ll_context *)((char *)block + skip);
+	memset(ctx, 0, sizeof(*ctx));
+	rest = (char *)(ctx + 1);
+	size -= skip + sizeof(*ctx);
+	history = size / 100 * LL_HISTORY_SHARE;
+	ll_arena_init(&ctx->arena, rest, size - history);
+	ll_arena_init(&ctx->history_arena, rest + (size - history), history);
+	context_init(ctx, &ctx->arena.alloc, &ctx->history_arena.alloc);
+	/* Everything needed to begin with must fit */
+	for (i = 0; i < LL_ALLOC_KINDS; ++i)
+		if (ctx->memory[i].stats.blocks
+				!= ctx->memory[i].stats.allocations)
+			return NULL;
+	return ctx;
+}
+
+static void context_init(struct ll_context *ctx,
+		const struct ll_allocator *alloc,
+		const struct ll_allocator *history)
+{
+	struct ll_counter *memory = ctx->memory;
+	int i;
+
+	for (i = 0; i < LL_ALLOC_KINDS; ++i)
+		ll_counter_init(&memory[i],
+				i == LL_ALLOC_HISTORY ? history : alloc);
+	/* The context itself was there before it could be counted */
+	memory[LL_ALLOC_CONTEXT].stats.bytes = sizeof(*ctx);
+	memory[LL_ALLOC_CONTEXT].stats.blocks = 1;
+	memory[LL_ALLOC_CONTEXT].stats.allocations = 1;
+	ctx->last_command = NULL;
+	ll_history_init_alloc(&ctx->history, 0,
+			&memory[LL_ALLOC_HISTORY].alloc);
+	ll_buf_init_alloc(&ctx->prompt, &memory[LL_ALLOC_BUFFER].alloc);
+	ll_gap_init_alloc(&ctx->buffer, &memory[LL_ALLOC_BUFFER].alloc);
+	ll_buf_init_alloc(&ctx->clipboard, &memory[LL_ALLOC_BUFFER].alloc);
+	ll_buf_init_alloc(&ctx->paste, &memory[LL_ALLOC_BUFFER].alloc);
+	ll_buf_init_alloc(&ctx->search, &memory[LL_ALLOC_BUFFER].alloc);
+	ll_buf_init_alloc(&ctx->search_prompt, &memory[LL_ALLOC_BUFFER].alloc);
+	ll_buf_init_alloc(&ctx->suggest_for, &memory[LL_ALLOC_BUFFER].alloc);
+	ctx->in = STDIN_FILENO;
+	ctx->out = STDOUT_FILENO;
+	ll_display_init_alloc(&ctx->display, ctx->out,
+			&memory[LL_ALLOC_DISPLAY].alloc);
+}
+
+void ll_context_delete(struct ll_context *ctx)
+{
+	if (ctx->initialized)
+		keyboard_deinit(ctx);
+	ll_fsm_deinit(&ctx->bindings);
+	ll_history_clear(&ctx->history);
+	ll_history_deinit(&ctx->history);
+	set_history_file(ctx, NULL);
+	ll_buf_deinit(&ctx->prompt);
+	ll_gap_deinit(&ctx->buffer);
+	ll_buf_deinit(&ctx->clipboard);
+	ll_buf_deinit(&ctx->paste);
+	ll_buf_deinit(&ctx->search);
+	ll_buf_deinit(&ctx->search_prompt);
+	ll_buf_deinit(&ctx->suggest_for);
+	ll_display_deinit(&ctx->display);
+	if (ctx->alloc != NULL)
+		ctx->alloc->free(ctx->alloc->user, ctx, sizeof(*ctx));
+}
+
+int ll_get_alloc_stats_ctx(struct ll_context *ctx,
+		struct ll_alloc_stats stats[LL_ALLOC_KINDS])
+{
+	int i;
+
+	for (i = 0; i < LL_ALLOC_KINDS; ++i)
+		stats[i] = ctx->memory[i].stats;
 	return 0;
 }
 
-const char *ll_read(const char *prompt)
+int ll_set_terminal_ctx(struct ll_context *ctx, int in, int out)
 {
-	int retval;
+	if (ctx->initialized) {
+		keyboard_deinit(ctx);
+		ctx->initialized = 0;
+	}
+	ctx->in = in;
+	ctx->out = out;
+	ctx->display.fd = out;
+	return 0;
+}
+
+static void set_history(struct ll_context *ctx, size_t max_lines)
+{
+	ll_history_clear(&ctx->history);
+	ll_history_deinit(&ctx->history);
+	ll_history_init_alloc(&ctx->history, max_lines,
+			&ctx->memory[LL_ALLOC_HISTORY].alloc);
+	ll_history_erase_dups(&ctx->history, ctx->erase_dups);
+	ctx->focus = 0;
+}
 
-	if (cl.initialized == 0) {
-		cl.initialized = 1;
-		cl.last_command = NULL;
-		ll_buf_init(&cl.buffer);
-		ll_buf_init(&cl.clipboard);
-		keyboard_init();
+static int set_history_file(struct ll_context *ctx, const char *path)
+{
+	const struct ll_allocator *alloc = &ctx->memory[LL_ALLOC_CONTEXT].alloc;
+	char *copy = NULL;
+
+	if (path != NULL) {
+		copy = alloc->malloc(alloc->user, strlen(path) + 1);
+		if (copy == NULL)
+			return -1;
+		strcpy(copy, path);
 	}
+	if (ctx->history_file != NULL)
+		alloc->free(alloc->user, ctx->history_file,
+				strlen(ctx->history_file) + 1);
+	ctx->history_file = copy;
+	return 0;
+}
+
+int ll_set_history_ctx(struct ll_context *ctx, size_t max_lines)
+{
+	set_history(ctx, max_lines);
+	return set_history_file(ctx, NULL);
+}
+
+int ll_set_history_with_file_ctx(struct ll_context *ctx, size_t max_lines,
+		const char *path)
+{
+	set_history(ctx, max_lines);
+	if (set_history_file(ctx, path) != 0)
+		return -1;
+	return ll_history_read(&ctx->history, path);
+}
+
+int ll_set_key_bindings_ctx(struct ll_context *ctx,
+		const struct ll_binding *bindings)
+{
+	ll_fsm_deinit(&ctx->bindings);
+	return ll_fsm_init_alloc(&ctx->bindings, bindings,
+			&ctx->memory[LL_ALLOC_BINDING].alloc);
+}
+
+int ll_set_horizontal_scroll_ctx(struct ll_context *ctx, int enable)
+{
+	ctx->hscroll = enable;
+	return 0;
+}
+
+int ll_set_history_erase_dups_ctx(struct ll_context *ctx, int enable)
+{
+	ctx->erase_dups = enable;
+	ll_history_erase_dups(&ctx->history, enable);
+	return 0;
+}
+
+int ll_set_history_search_prefix_ctx(struct ll_context *ctx, int enable)
+{
+	ctx->prefix_search = enable;
+	return 0;
+}
 
-	ll_buf_assign(&cl.buffer, "", 0);
-	cl.fmt_len = 0;
-	cl.current = cl.buffer.str;
-	cl.focus = cl.history.size;
-	cl.cursor = 0;
-	cl.fmt_cursor = 0;
+int ll_set_autosuggest_ctx(struct ll_context *ctx, int enable)
+{
+	ctx->autosuggest = enable;
+	return 0;
+}
+
+int ll_terminal_resized_ctx(struct ll_context *ctx)
+{
+	ll_display_resized(&ctx->display);
+	return 0;
+}
+
+int ll_get_frame_stats_ctx(struct ll_context *ctx,
+		struct ll_frame_stats *stats)
+{
+	*stats = ctx->display.stats;
+	return 0;
+}
 
-	write(STDOUT_FILENO, prompt, strlen(prompt));
-	write(STDOUT_FILENO, " ", 1);
+const char *ll_read_ctx(struct ll_context *ctx, const char *prompt)
+{
+	size_t used;
+	int retval;
 
+	start(ctx, prompt);
 	do {
-		reprint_line();
-		retval = handle_character();
+		if (ctx->input_begin == ctx->input_end) {
+			/* Everything read so far has been handled: show the result */
+			reprint_line(ctx);
+			/* Once a sequence has started, don't wait forever for the
+			 * rest */
+			retval = keyboard_fill(ctx,
+					ctx->keys_len > 0 ? LL_KEY_TIMEOUT : -1);
+			if (retval == EOF)
+				break;
+			if (retval == LL_KEY_NONE) {
+				retval = handle_key(ctx, LL_KEY_NONE);
+				continue;
+			}
+		}
+		retval = handle_input(ctx, ctx->input + ctx->input_begin,
+				ctx->input_end - ctx->input_begin, &used);
+		ctx->input_begin += used;
 	} while (retval == 0);
+	finish_line(ctx);
+
+	if (retval == 1)
+		return ll_gap_str(&ctx->buffer);
+	/* Leave the terminal as it was once there is nothing more to read */
+	keyboard_deinit(ctx);
+	ctx->initialized = 0;
+	return NULL;
+}
+
+int ll_begin(struct ll_context *ctx, const char *prompt,
+		void (*on_line) (struct ll_context *, const char *))
+{
+	start(ctx, prompt);
+	ctx->on_line = on_line;
+	reprint_line(ctx);
+	return 0;
+}
+
+int ll_feed(struct ll_context *ctx, const void *bytes, size_t len)
+{
+	void (*on_line) (struct ll_context *, const char *);
+	size_t used;
+	int retval;
+
+	if (ctx->on_line == NULL)
+		return -1;
+	do {
+		if (len > 0) {
+			retval = handle_input(ctx, bytes, len, &used);
+			bytes = (const char *)bytes + used;
+			len -= used;
+		} else {
+			retval = handle_key(ctx, LL_KEY_NONE);
+		}
+		if (retval == LL_END_OF_INPUT) {
+			on_line = ctx->on_line;
+			ll_end(ctx);
+			on_line(ctx, NULL);
+			return 0;
+		}
+		if (retval > 0) {
+			finish_line(ctx);
+			ctx->on_line(ctx, ll_gap_str(&ctx->buffer));
+			/* Go on with the next line, unless the callback ended the
+			 * session */
+			if (ctx->on_line == NULL)
+				return 0;
+			begin_line(ctx);
+		}
+	} while (len > 0);
+	reprint_line(ctx);
+	return ctx->display.frame.len > 0;
+}
+
+int ll_flush(struct ll_context *ctx)
+{
+	ll_display_flush(&ctx->display);
+	return ctx->display.frame.len > 0;
+}
+
+void ll_end(struct ll_context *ctx)
+{
+	ctx->on_line = NULL;
+	finish_line(ctx);
+	keyboard_deinit(ctx);
+	ctx->initialized = 0;
+}
+
+static struct ll_context *default_context(void)
+{
+	if (ll_default_context == NULL)
+#if LL_MEMORY_SIZE > 0
+		ll_default_context = ll_context_new_fixed(ll_memory,
+				sizeof(ll_memory));
+#else
+		ll_default_context = ll_context_new();
+#endif
+	return ll_default_context;
+}
+
+int ll_set_history(size_t max_lines)
+{
+	struct ll_context *ctx = default_context();
+
+	if (ctx == NULL)
+		return -1;
+	return ll_set_history_ctx(ctx, max_lines);
+}
+
+int ll_set_history_with_file(size_t max_lines, const char *path)
+{
+	struct ll_context *ctx = default_context();
+
+	if (ctx == NULL)
+		return -1;
+	return ll_set_history_with_file_ctx(ctx, max_lines, path);
+}
+
+int ll_set_key_bindings(const struct ll_binding *bindings)
+{
+	struct ll_context *ctx = default_context();
+
+	if (ctx == NULL)
+		return -1;
+	return ll_set_key_bindings_ctx(ctx, bindings);
+}
+
+int ll_set_horizontal_scroll(int enable)
+{
+	struct ll_context *ctx = default_context();
+
+	if (ctx == NULL)
+		return -1;
+	return ll_set_horizontal_scroll_ctx(ctx, enable);
+}
+
+int ll_set_history_erase_dups(int enable)
+{
+	struct ll_context *ctx = default_context();
+
+	if (ctx == NULL)
+		return -1;
+	return ll_set_history_erase_dups_ctx(ctx, enable);
+}
 
-	reprint_line();
-	write(STDOUT_FILENO, "\n", 1);
+int ll_set_history_search_prefix(int enable)
+{
+	struct ll_context *ctx = default_context();
+
+	if (ctx == NULL)
+		return -1;
+	return ll_set_history_search_prefix_ctx(ctx, enable);
+}
+
+int ll_set_autosuggest(int enable)
+{
+	struct ll_context *ctx = default_context();
+
+	if (ctx == NULL)
+		return -1;
+	return ll_set_autosuggest_ctx(ctx, enable);
+}
 
-	if (retval < 0)
+int ll_terminal_resized(void)
+{
+	struct ll_context *ctx = default_context();
+
+	if (ctx == NULL)
+		return -1;
+	return ll_terminal_resized_ctx(ctx);
+}
+
+int ll_get_frame_stats(struct ll_frame_stats *stats)
+{
+	struct ll_context *ctx = default_context();
+
+	if (ctx == NULL)
+		return -1;
+	return ll_get_frame_stats_ctx(ctx, stats);
+}
+
+int ll_get_alloc_stats(struct ll_alloc_stats stats[LL_ALLOC_KINDS])
+{
+	struct ll_context *ctx = default_context();
+
+	if (ctx == NULL)
+		return -1;
+	return ll_get_alloc_stats_ctx(ctx, stats);
+}
+
+const char *ll_read(const char *prompt)
+{
+	struct ll_context *ctx = default_context();
+
+	if (ctx == NULL)
 		return NULL;
-	return cl.buffer.str;
+	return ll_read_ctx(ctx, prompt);
 }
 
-int ll_backward_char(void)
+int ll_backward_char(struct ll_context *ctx)
 {
-	if (cl.cursor == 0)
+	if (ctx->cursor == 0)
 		return -1;
 	do
-		--cl.cursor;
-	while ((cl.current[cl.cursor] & 0xC0) == 0x80);
+		--ctx->cursor;
+	while ((char_at(ctx, ctx->cursor) & 0xC0) == 0x80);
 	return 0;
 }
 
-int ll_forward_char(void)
+int ll_forward_char(struct ll_context *ctx)
 {
-	if (cl.current[cl.cursor] == 0)
-		return -1;
+	if (char_at(ctx, ctx->cursor) == 0)
+		return accept_suggestion(ctx);
 	do
-		++cl.cursor;
-	while ((cl.current[cl.cursor] & 0xC0) == 0x80);
+		++ctx->cursor;
+	while ((char_at(ctx, ctx->cursor) & 0xC0) == 0x80);
 	return 0;
 }
 
-int ll_backward_word(void)
+int ll_backward_word(struct ll_context *ctx)
 {
-	if (cl.cursor == 0)
+	if (ctx->cursor == 0)
 		return -1;
-	--cl.cursor;
-	while (cl.cursor >= 0 && !isalnum(cl.current[cl.cursor]))
-		--cl.cursor;
-	while (cl.cursor >= 0 && isalnum(cl.current[cl.cursor]))
-		--cl.cursor;
-	++cl.cursor;
+	--ctx->cursor;
+	while (ctx->cursor >= 0 && !isalnum(char_at(ctx, ctx->cursor)))
+		--ctx->cursor;
+	while (ctx->cursor >= 0 && isalnum(char_at(ctx, ctx->cursor)))
+		--ctx->cursor;
+	++ctx->cursor;
 	return 0;
 }
 
-int ll_forward_word(void)
+int ll_forward_word(struct ll_context *ctx)
 {
-	if (cl.current[cl.cursor + 1] == 0)
+	if (char_at(ctx, ctx->cursor + 1) == 0)
 		return -1;
-	while (cl.current[cl.cursor] != 0 && !isalnum(cl.current[cl.cursor]))
-		++cl.cursor;
-	while (cl.current[cl.cursor] != 0 && isalnum(cl.current[cl.cursor]))
-		++cl.cursor;
-	while (cl.current[cl.cursor] != 0 && !isalnum(cl.current[cl.cursor]))
-		++cl.cursor;
+	while (char_at(ctx, ctx->cursor) != 0 && !isalnum(char_at(ctx, ctx->cursor)))
+		++ctx->cursor;
+	while (char_at(ctx, ctx->cursor) != 0 && isalnum(char_at(ctx, ctx->cursor)))
+		++ctx->cursor;
+	while (char_at(ctx, ctx->cursor) != 0 && !isalnum(char_at(ctx, ctx->cursor)))
+		++ctx->cursor;
 	return 0;
 }
 
-int ll_beginning_of_line(void)
+int ll_beginning_of_line(struct ll_context *ctx)
 {
-	cl.cursor = 0;
+	ctx->cursor = 0;
 	return 0;
 }
 
-int ll_end_of_line(void)
+int ll_end_of_line(struct ll_context *ctx)
 {
-	cl.cursor = strlen(cl.current);
+	if ((size_t)ctx->cursor == line_len(ctx))
+		accept_suggestion(ctx);
+	ctx->cursor = line_len(ctx);
 	return 0;
 }
 
-int ll_previous_history(void)
+int ll_previous_history(struct ll_context *ctx)
 {
-	if (cl.focus == 0)
+	if (ctx->prefix_search)
+		return ll_history_search_backward(ctx);
+	if (ctx->focus == 0)
 		return -1;
-	--cl.focus;
-	cl.current = ll_history_index(&cl.history, cl.focus);
-	cl.cursor = strlen(cl.current);
+	--ctx->focus;
+	ctx->current = ll_history_index(&ctx->history, ctx->focus);
+	ctx->cursor = line_len(ctx);
 	return 0;
 }
 
-int ll_next_history(void)
+int ll_next_history(struct ll_context *ctx)
 {
-	if (cl.focus == cl.history.size)
+	if (ctx->prefix_search)
+		return ll_history_search_forward(ctx);
+	if (ctx->focus == ctx->history.size)
 		return -1;
-	++cl.focus;
-	if (cl.focus == cl.history.size)
-		cl.current = cl.buffer.str;
+	++ctx->focus;
+	if (ctx->focus == ctx->history.size)
+		ctx->current = NULL;
 	else
-		cl.current = ll_history_index(&cl.history, cl.focus);
-	cl.cursor = strlen(cl.current);
+		ctx->current = ll_history_index(&ctx->history, ctx->focus);
+	ctx->cursor = line_len(ctx);
 	return 0;
 }
 
-int ll_beginning_of_history(void)
+int ll_beginning_of_history(struct ll_context *ctx)
 {
-	cl.focus = 0;
-	cl.current = ll_history_index(&cl.history, cl.focus);
-	cl.cursor = strlen(cl.current);
+	if (ctx->history.size == 0)
+		return -1;
+	ctx->focus = 0;
+	ctx->current = ll_history_index(&ctx->history, ctx->focus);
+	ctx->cursor = line_len(ctx);
 	return 0;
 }
 
-int ll_end_of_history(void)
+int ll_end_of_history(struct ll_context *ctx)
 {
-	cl.focus = cl.history.size;
-	cl.current = cl.buffer.str;
-	cl.cursor = strlen(cl.current);
+	ctx->focus = ctx->history.size;
+	ctx->current = NULL;
+	ctx->cursor = line_len(ctx);
 	return 0;
 }
 
-int ll_end_of_file(void)
+int ll_history_search_backward(struct ll_context *ctx)
 {
-	if (strlen(cl.current) == 0)
-		return ll_terminate();
-	return ll_delete_char();
+	size_t index = ctx->focus;
+
+	if (ll_history_search_prefix(&ctx->history, line_str(ctx),
+				ctx->cursor, &index) != 0)
+		return -1;
+	view_line(ctx, index);
+	return 0;
 }
 
-int ll_delete_char(void)
+int ll_history_search_forward(struct ll_context *ctx)
 {
-	if (cl.current[cl.cursor] == 0)
+	size_t index = ctx->focus;
+
+	if (ctx->focus == ctx->history.size)
 		return -1;
-	pop_line();
-	if ((cl.current[cl.cursor] & 0x80) == 0)
-		ll_buf_erase(&cl.buffer, cl.cursor, 1);
-	else if ((cl.current[cl.cursor] & 0xE0) == 0xC0)
-		ll_buf_erase(&cl.buffer, cl.cursor, 2);
-	else if ((cl.current[cl.cursor] & 0xF0) == 0xE0)
-		ll_buf_erase(&cl.buffer, cl.cursor, 3);
-	else if ((cl.current[cl.cursor] & 0xF8) == 0xF0)
-		ll_buf_erase(&cl.buffer, cl.cursor, 4);
-	else if ((cl.current[cl.cursor] & 0xFC) == 0xF8)
-		ll_buf_erase(&cl.buffer, cl.cursor, 5);
-	cl.current = cl.buffer.str;
+	/* Past the newest match is the line being edited */
+	if (ll_history_search_prefix_forward(&ctx->history, line_str(ctx),
+				ctx->cursor, &index) != 0)
+		index = ctx->history.size;
+	view_line(ctx, index);
+	if (ctx->cursor > line_len(ctx))
+		ctx->cursor = line_len(ctx);
 	return 0;
 }
 
-int ll_backward_delete_char(void)
+int ll_reverse_search_history(struct ll_context *ctx)
 {
-	if (ll_backward_char() != 0)
+	ctx->searching = 1;
+	ctx->search_focus = ctx->focus;
+	ctx->search_cursor = ctx->cursor;
+	ctx->search_failed = 0;
+	ctx->search_match_len = 0;
+	ll_buf_truncate(&ctx->search, 0);
+	show_search(ctx);
+	return 0;
+}
+
+int ll_end_of_file(struct ll_context *ctx)
+{
+	if (line_len(ctx) == 0)
+		return ll_terminate(ctx);
+	return ll_delete_char(ctx);
+}
+
+int ll_delete_char(struct ll_context *ctx)
+{
+	if (char_at(ctx, ctx->cursor) == 0)
+		return -1;
+	pop_line(ctx);
+	if ((char_at(ctx, ctx->cursor) & 0x80) == 0)
+		ll_gap_erase(&ctx->buffer, ctx->cursor, 1);
+	else if ((char_at(ctx, ctx->cursor) & 0xE0) == 0xC0)
+		ll_gap_erase(&ctx->buffer, ctx->cursor, 2);
+	else if ((char_at(ctx, ctx->cursor) & 0xF0) == 0xE0)
+		ll_gap_erase(&ctx->buffer, ctx->cursor, 3);
+	else if ((char_at(ctx, ctx->cursor) & 0xF8) == 0xF0)
+		ll_gap_erase(&ctx->buffer, ctx->cursor, 4);
+	else if ((char_at(ctx, ctx->cursor) & 0xFC) == 0xF8)
+		ll_gap_erase(&ctx->buffer, ctx->cursor, 5);
+	return 0;
+}
+
+int ll_backward_delete_char(struct ll_context *ctx)
+{
+	if (ll_backward_char(ctx) != 0)
 		return -1;
-	if (ll_delete_char() != 0)
+	if (ll_delete_char(ctx) != 0)
 		return -1;
 	return 0;
 }
 
-int ll_forward_kill_line(void)
+int ll_forward_kill_line(struct ll_context *ctx)
 {
+	const char *text;
 	size_t len;
 
-	if (cl.current[cl.cursor] == 0)
+	if (char_at(ctx, ctx->cursor) == 0)
 		return 0;
-	pop_line();
-	len = cl.buffer.len - cl.cursor;
-	if (cl.last_command == ll_forward_kill_word)
-		ll_buf_append(&cl.clipboard, cl.buffer.str + cl.cursor, len);
+	pop_line(ctx);
+	len = ll_gap_len(&ctx->buffer) - ctx->cursor;
+	text = ll_gap_span(&ctx->buffer, ctx->cursor, len);
+	if (ctx->last_command == ll_forward_kill_word)
+		ll_buf_append(&ctx->clipboard, text, len);
 	else
-		ll_buf_assign(&cl.clipboard, cl.buffer.str + cl.cursor, len);
-	ll_buf_erase(&cl.buffer, cl.cursor, len);
-	cl.current = cl.buffer.str;
+		ll_buf_assign(&ctx->clipboard, text, len);
+	ll_gap_erase(&ctx->buffer, ctx->cursor, len);
 	return 0;
 }
 
-int ll_backward_kill_line(void)
+int ll_backward_kill_line(struct ll_context *ctx)
 {
-	if (cl.cursor == 0)
+	const char *text;
+
+	if (ctx->cursor == 0)
 		return 0;
-	pop_line();
-	if (cl.last_command == ll_backward_kill_word)
-		ll_buf_prepend(&cl.clipboard, cl.buffer.str, cl.cursor);
+	pop_line(ctx);
+	text = ll_gap_span(&ctx->buffer, 0, ctx->cursor);
+	if (ctx->last_command == ll_backward_kill_word)
+		ll_buf_prepend(&ctx->clipboard, text, ctx->cursor);
 	else
-		ll_buf_assign(&cl.clipboard, cl.buffer.str, cl.cursor);
-	ll_buf_erase(&cl.buffer, 0, cl.cursor);
-	cl.current = cl.buffer.str;
-	cl.cursor = 0;
+		ll_buf_assign(&ctx->clipboard, text, ctx->cursor);
+	ll_gap_erase(&ctx->buffer, 0, ctx->cursor);
+	ctx->cursor = 0;
 	return 0;
 }
 
-int ll_forward_kill_word(void)
+int ll_forward_kill_word(struct ll_context *ctx)
 {
+	const char *text;
 	size_t begin;
 	size_t len;
 
-	if (cl.current[cl.cursor] == 0)
+	if (char_at(ctx, ctx->cursor) == 0)
 		return 0;
-	pop_line();
-	begin = cl.cursor;
-	ll_forward_word();
-	len = cl.cursor - begin;
-	if (cl.last_command == ll_forward_kill_word)
-		ll_buf_append(&cl.clipboard, cl.buffer.str + begin, len);
+	pop_line(ctx);
+	begin = ctx->cursor;
+	ll_forward_word(ctx);
+	len = ctx->cursor - begin;
+	text = ll_gap_span(&ctx->buffer, begin, len);
+	if (ctx->last_command == ll_forward_kill_word)
+		ll_buf_append(&ctx->clipboard, text, len);
 	else
-		ll_buf_assign(&cl.clipboard, cl.buffer.str + begin, len);
-	ll_buf_erase(&cl.buffer, begin, len);
-	cl.current = cl.buffer.str;
-	cl.cursor = begin;
+		ll_buf_assign(&ctx->clipboard, text, len);
+	ll_gap_erase(&ctx->buffer, begin, len);
+	ctx->cursor = begin;
 	return 0;
 }
 
-int ll_backward_kill_word(void)
+int ll_backward_kill_word(struct ll_context *ctx)
 {
+	const char *text;
 	size_t end;
 	size_t len;
 
-	if (cl.cursor == 0)
+	if (ctx->cursor == 0)
 		return 0;
-	pop_line();
-	end = cl.cursor;
-	ll_backward_word();
-	len = end - cl.cursor;
-	if (cl.last_command == ll_backward_kill_word)
-		ll_buf_prepend(&cl.clipboard, cl.buffer.str + cl.cursor, len);
+	pop_line(ctx);
+	end = ctx->cursor;
+	ll_backward_word(ctx);
+	len = end - ctx->cursor;
+	text = ll_gap_span(&ctx->buffer, ctx->cursor, len);
+	if (ctx->last_command == ll_backward_kill_word)
+		ll_buf_prepend(&ctx->clipboard, text, len);
 	else
-		ll_buf_assign(&cl.clipboard, cl.buffer.str + cl.cursor, len);
-	ll_buf_erase(&cl.buffer, cl.cursor, len);
-	cl.current = cl.buffer.str;
+		ll_buf_assign(&ctx->clipboard, text, len);
+	ll_gap_erase(&ctx->buffer, ctx->cursor, len);
+	return 0;
+}
+
+int ll_yank(struct ll_context *ctx)
+{
+	if (ctx->clipboard.len)
+		insert_str(ctx, ctx->clipboard.str, ctx->clipboard.len);
 	return 0;
 }
 
-int ll_yank(void)
+int ll_verbatim(struct ll_context *ctx)
 {
-	if (cl.clipboard.len)
-		insert_str(cl.clipboard.str, cl.clipboard.len);
+	ctx->mode = LL_MODE_VERBATIM;
 	return 0;
 }
 
-int ll_verbatim(void)
+int ll_bracketed_paste(struct ll_context *ctx)
 {
-	reprint_line();
-	insert_char(keyboard_get());
+	ll_buf_assign(&ctx->paste, "", 0);
+	ctx->paste_matched = 0;
+	ctx->mode = LL_MODE_PASTE;
 	return 0;
 }
 
-int ll_accept_line(void)
+int ll_accept_line(struct ll_context *ctx)
 {
-	pop_line();
-	push_line();
+	pop_line(ctx);
+	push_line(ctx);
 	return 1;
 }
 
-int ll_terminate(void)
+int ll_abort(struct ll_context *ctx)
+{
+	/* Only a search can be cancelled */
+	return -1;
+}
+
+int ll_terminate(struct ll_context *ctx)
 {
-	write(STDOUT_FILENO, "\n", 1);
-	keyboard_deinit();
-	exit(EXIT_FAILURE);
+	return LL_END_OF_INPUT;
 }
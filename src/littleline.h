@@ -5,39 +5,209 @@
 
 #include <stdlib.h>
 
+#include "alloc.h"
 #include "binding.h"
+#include "display.h"
+
+
+/**
+ * Contexts
+ * --------
+ *
+ * A context holds everything about a line editing session: the key bindings,
+ * the history, the line being edited and the state of the terminal. Separate
+ * contexts share nothing, so each one may be used from a different thread.
+ */
+/**
+ * Choose the allocator for the contexts created from now on, including the
+ * default one; if ``alloc`` is NULL, the C library heap is used, as it is
+ * until this is called
+ */
+int ll_set_allocator(const struct ll_allocator *alloc);
+/**
+ * Create a context with no history or key bindings, reading from the standard
+ * input and writing to the standard output; return NULL if there is not
+ * enough memory
+ */
+struct ll_context *ll_context_new(void);
+/**
+ * Same as ``ll_context_new()``, taking all the memory for the context from
+ * ``alloc`` instead of the allocator set with ``ll_set_allocator()``
+ */
+struct ll_context *ll_context_new_alloc(const struct ll_allocator *alloc);
+/**
+ * Same as ``ll_context_new()``, putting the context and everything it needs
+ * in the ``size`` bytes at ``block``, so that no memory is ever requested from
+ * the system; ``LL_HISTORY_SHARE`` percent of the block, half by default, is
+ * kept for the history. Return NULL if the block is too small to begin with.
+ * Once the block is full, text that does not fit in the line or the
+ * clipboard is cut, and the oldest lines of the history are dropped to make
+ * room for new ones. The block must outlive the context
+ */
+struct ll_context *ll_context_new_fixed(void *block, size_t size);
+/**
+ * Destroy a context, restoring the terminal if it was used
+ */
+void ll_context_delete(struct ll_context *ctx);
 
 
 /**
  * Initialization
  * --------------
  *
- * These functions should be called before ``ll_read()``
+ * These functions should be called before ``ll_read_ctx()`` or
+ * ``ll_begin()``
  */
 /** Key bindings for ANSI escape sequences */
 extern struct ll_binding LL_ANSI_KEY_BINDINGS[];
+/**
+ * Read keys from the file descriptor ``in`` and print the line to ``out``;
+ * if ``in`` is a terminal, it is put in raw mode while lines are read, but
+ * pipes, sockets and files are used as they are
+ */
+int ll_set_terminal_ctx(struct ll_context *ctx, int in, int out);
 /**
  * Initialize history
  */
-int ll_set_history(size_t max_lines);
+int ll_set_history_ctx(struct ll_context *ctx, size_t max_lines);
 /**
  * Initialize history with data
  *
  * Set the maximum number of lines in the history, and attach a file to it: if
  * the file contains lines, they will be loaded, and then a line will be added
- * to it every time the user enters it
+ * to it every time the user enters it; once the file gets twice as long as
+ * the history, it is written again with just the lines in the history
  */
-int ll_set_history_with_file(size_t max_lines, const char *path);
+int ll_set_history_with_file_ctx(struct ll_context *ctx, size_t max_lines,
+		const char *path);
 /**
- * Initialize key bindings
+ * Initialize key bindings; return -1 if there is not enough memory for all of
+ * them
  */
-int ll_set_key_bindings(const struct ll_binding *bindings);
+int ll_set_key_bindings_ctx(struct ll_context *ctx,
+		const struct ll_binding *bindings);
+
+/**
+ * Choose how lines wider than the terminal are shown: by default they wrap
+ * into several rows; if ``enable`` is set, they scroll horizontally in a
+ * single row instead, with markers showing where text is cut off
+ */
+int ll_set_horizontal_scroll_ctx(struct ll_context *ctx, int enable);
+/**
+ * If ``enable`` is set, make accepting a line that is already in the history
+ * erase the older copy of it, so that the history holds every line only once
+ */
+int ll_set_history_erase_dups_ctx(struct ll_context *ctx, int enable);
+/**
+ * If ``enable`` is set, make ``ll_previous_history()`` and
+ * ``ll_next_history()`` skip the lines that do not start with the text before
+ * the cursor, as ``ll_history_search_backward()`` and
+ * ``ll_history_search_forward()`` do
+ */
+int ll_set_history_search_prefix_ctx(struct ll_context *ctx, int enable);
+/**
+ * If ``enable`` is set, show dimmed after the line being edited the rest of
+ * the newest line in the history that starts with it, while the cursor is at
+ * its end; ``ll_forward_char()`` and ``ll_end_of_line()`` insert it from there
+ */
+int ll_set_autosuggest_ctx(struct ll_context *ctx, int enable);
+/**
+ * Tell the context that the terminal may have been resized, so that its width
+ * is checked again before the line is drawn; otherwise it is only checked as
+ * each line begins. The library leaves signals alone: this is meant to be
+ * called by the program from its own handler for ``SIGWINCH``, which it is
+ * safe to do
+ */
+int ll_terminal_resized_ctx(struct ll_context *ctx);
+/**
+ * Copy the output statistics to ``stats``
+ */
+int ll_get_frame_stats_ctx(struct ll_context *ctx,
+		struct ll_frame_stats *stats);
+/**
+ * Copy the memory currently used by each part of the library to ``stats``,
+ * indexed by ``LL_ALLOC_CONTEXT``, ``LL_ALLOC_BUFFER`` and so on
+ */
+int ll_get_alloc_stats_ctx(struct ll_context *ctx,
+		struct ll_alloc_stats stats[LL_ALLOC_KINDS]);
 
 /**
  * Prints ``prompt``, then allows the user to edit a line, that is returned
  * when the Return---or a key sequence associated with ``ll_accept_line()``---
- * is pressed
+ * is pressed; the line belongs to the context, and is valid until the next
+ * call. Return NULL once the input ends, leaving the terminal as it was
+ */
+const char *ll_read_ctx(struct ll_context *ctx, const char *prompt);
+
+
+/**
+ * Callback Interface
+ * ------------------
+ *
+ * Instead of waiting for a whole line in ``ll_read_ctx()``, input can be
+ * handed over as it arrives, e.g. from an event loop that watches many file
+ * descriptors; none of these functions ever blocks waiting for input
+ */
+/**
+ * Print ``prompt`` and start editing a line; ``on_line`` is called with the
+ * context and the line every time one is accepted, and then a new line is
+ * started with the same prompt. Once the input ends, editing stops as with
+ * ``ll_end()``, and ``on_line`` is called with NULL
  */
+int ll_begin(struct ll_context *ctx, const char *prompt,
+		void (*on_line) (struct ll_context *ctx, const char *line));
+/**
+ * Handle ``len`` bytes of input and redraw the line; with no bytes, a key
+ * sequence that was left incomplete is taken as it is, which should be done
+ * when nothing else arrives for a while, e.g. to tell a lone Escape from the
+ * beginning of a longer sequence. Return -1 if no line is being edited, or 1
+ * if the output can't take all that was drawn without blocking; the rest is
+ * written first the next time, or by ``ll_flush()``
+ */
+int ll_feed(struct ll_context *ctx, const void *bytes, size_t len);
+/**
+ * Write what is left of the output, e.g. once its file descriptor is ready
+ * for it; return 1 if some of it still can't be written without blocking
+ */
+int ll_flush(struct ll_context *ctx);
+/**
+ * Stop editing lines, leaving the terminal as it was; may be called from the
+ * ``on_line`` callback
+ */
+void ll_end(struct ll_context *ctx);
+
+
+/**
+ * Default Context
+ * ---------------
+ *
+ * These functions work as the ones above on a context of their own, created
+ * the first time any of them is called; if ``MEMORY_SIZE`` is set in
+ * ``config.mk``, it is put in a static block of that many bytes, as with
+ * ``ll_context_new_fixed()``. If it can't be created, they return -1, or
+ * NULL for ``ll_read()``
+ */
+/** Same as ``ll_set_history_ctx()`` */
+int ll_set_history(size_t max_lines);
+/** Same as ``ll_set_history_with_file_ctx()`` */
+int ll_set_history_with_file(size_t max_lines, const char *path);
+/** Same as ``ll_set_key_bindings_ctx()`` */
+int ll_set_key_bindings(const struct ll_binding *bindings);
+/** Same as ``ll_set_horizontal_scroll_ctx()`` */
+int ll_set_horizontal_scroll(int enable);
+/** Same as ``ll_set_history_erase_dups_ctx()`` */
+int ll_set_history_erase_dups(int enable);
+/** Same as ``ll_set_history_search_prefix_ctx()`` */
+int ll_set_history_search_prefix(int enable);
+/** Same as ``ll_set_autosuggest_ctx()`` */
+int ll_set_autosuggest(int enable);
+/** Same as ``ll_terminal_resized_ctx()`` */
+int ll_terminal_resized(void);
+/** Same as ``ll_get_frame_stats_ctx()`` */
+int ll_get_frame_stats(struct ll_frame_stats *stats);
+/** Same as ``ll_get_alloc_stats_ctx()`` */
+int ll_get_alloc_stats(struct ll_alloc_stats stats[LL_ALLOC_KINDS]);
+/** Same as ``ll_read_ctx()`` */
 const char *ll_read(const char *prompt);
 
 
@@ -45,53 +215,68 @@ const char *ll_read(const char *prompt);
  * Commands
  * --------
  *
- * Functions that can be bound to keystrokes 
+ * Functions that can be bound to keystrokes; they all take the context they
+ * operate on
  */
 /** Move back a character */
-int ll_backward_char(void);
+int ll_backward_char(struct ll_context *ctx);
 /** Move forward a character */
-int ll_forward_char(void);
+int ll_forward_char(struct ll_context *ctx);
 /** Move backward a word */
-int ll_backward_word(void);
+int ll_backward_word(struct ll_context *ctx);
 /** Move forward a word */
-int ll_forward_word(void);
+int ll_forward_word(struct ll_context *ctx);
 /** Move to the beginning of the line */
-int ll_beginning_of_line(void);
+int ll_beginning_of_line(struct ll_context *ctx);
 /** Move to the end of the line */
-int ll_end_of_line(void);
+int ll_end_of_line(struct ll_context *ctx);
 
 /** Pull the previous line from the history */
-int ll_previous_history(void);
+int ll_previous_history(struct ll_context *ctx);
 /** Pull the next line from the history */
-int ll_next_history(void);
+int ll_next_history(struct ll_context *ctx);
 /** Pull the first line from the history */
-int ll_beginning_of_history(void);
+int ll_beginning_of_history(struct ll_context *ctx);
 /** Pull the last line from the history, that is: the one being edited */
-int ll_end_of_history(void);
+int ll_end_of_history(struct ll_context *ctx);
+/** Pull the previous line from the history that starts with the text before
+ * the cursor, leaving the cursor where it is */
+int ll_history_search_backward(struct ll_context *ctx);
+/** Pull the next line from the history that starts with the text before the
+ * cursor, or else the one being edited */
+int ll_history_search_forward(struct ll_context *ctx);
+/** Search the history backwards for the text typed next, showing the newest
+ * line that holds it as it is typed; pressed again, look further back */
+int ll_reverse_search_history(struct ll_context *ctx);
 
-/** If there are characters on the buffer, delete one; if not, terminate */
-int ll_end_of_file(void);
+/** If there are characters on the buffer, delete one; if not, end the input */
+int ll_end_of_file(struct ll_context *ctx);
 /** Delete the character under the cursor */
-int ll_delete_char(void);
+int ll_delete_char(struct ll_context *ctx);
 /** Delete the character before the cursor */
-int ll_backward_delete_char(void);
+int ll_backward_delete_char(struct ll_context *ctx);
 /** Kill all characters from the cursor to the end of the line */
-int ll_forward_kill_line(void);
+int ll_forward_kill_line(struct ll_context *ctx);
 /** Kill all characters from the beginning of the line to the cursor */
-int ll_backward_kill_line(void);
+int ll_backward_kill_line(struct ll_context *ctx);
 /** Kill all characters from the cursor to the end of the word under it */
-int ll_forward_kill_word(void);
+int ll_forward_kill_word(struct ll_context *ctx);
 /** Kill all characters from the beginning of the word under the cursor to the
  * cursor itself */
-int ll_backward_kill_word(void);
+int ll_backward_kill_word(struct ll_context *ctx);
 /** Yank the last cut characters back to the line */
-int ll_yank(void);
+int ll_yank(struct ll_context *ctx);
 
 /** Write the next character to the line literally */
-int ll_verbatim(void);
+int ll_verbatim(struct ll_context *ctx);
+/** Insert the text pasted after this key sequence as it is, up to the
+ * sequence closing it */
+int ll_bracketed_paste(struct ll_context *ctx);
 /** Push the current line to the history and return it */
-int ll_accept_line(void);
-/** Terminate the process */
-int ll_terminate(void);
+int ll_accept_line(struct ll_context *ctx);
+/** Cancel the search going on, going back to the line viewed before it */
+int ll_abort(struct ll_context *ctx);
+/** End the input, as if the end of the file was reached */
+int ll_terminate(struct ll_context *ctx);
 
 #endif
@@ -0,0 +1,74 @@
+/* Copyright 2017 Luis Sanz <luis.sanz@gmail.com> */
+
+#include "scan.h"
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#define LL_SCAN_SSE2
+#include <immintrin.h>
+#endif
+
+#ifdef LL_SCAN_SSE2
+/* Scan 16 bytes at a time */
+static size_t scan_sse2(const char *str, size_t len);
+/* Scan 32 bytes at a time */
+static size_t scan_avx2(const char *str, size_t len);
+#endif
+
+size_t ll_scan_ascii(const char *str, size_t len)
+{
+#ifdef LL_SCAN_SSE2
+	/* The processor is looked at by the compiler runtime once, before
+	 * main(); asking it here every time keeps no state of our own that
+	 * threads would share */
+	if (__builtin_cpu_supports("avx2"))
+		return scan_avx2(str, len);
+	return scan_sse2(str, len);
+#else
+	return ll_scan_ascii_scalar(str, len);
+#endif
+}
+
+size_t ll_scan_ascii_scalar(const char *str, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; ++i)
+		if ((signed char)str[i] < 0x20)
+			break;
+	return i;
+}
+
+#ifdef LL_SCAN_SSE2
+static size_t scan_sse2(const char *str, size_t len)
+{
+	const __m128i limit = _mm_set1_epi8(0x1F);
+	unsigned mask;
+	size_t i;
+
+	/* Bytes over 0x7F are negative, so a signed comparison rules them out
+	 * along with control characters */
+	for (i = 0; i + 16 <= len; i += 16) {
+		mask = _mm_movemask_epi8(_mm_cmpgt_epi8(
+					_mm_loadu_si128((const __m128i *)(str + i)), limit));
+		if (mask != 0xFFFF)
+			return i + __builtin_ctz(~mask);
+	}
+	return i + ll_scan_ascii_scalar(str + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_avx2(const char *str, size_t len)
+{
+	const __m256i limit = _mm256_set1_epi8(0x1F);
+	unsigned mask;
+	size_t i;
+
+	for (i = 0; i + 32 <= len; i += 32) {
+		mask = _mm256_movemask_epi8(_mm256_cmpgt_epi8(
+					_mm256_loadu_si256((const __m256i *)(str + i)), limit));
+		if (mask != 0xFFFFFFFFu)
+			return i + __builtin_ctz(~mask);
+	}
+	return i + scan_sse2(str + i, len - i);
+}
+#endif
@@ -0,0 +1,27 @@
+/* Copyright 2017 Luis Sanz <luis.sanz@gmail.com> */
+
+#ifndef LITTLELINE_SCAN_H_
+#define LITTLELINE_SCAN_H_
+
+#include <stdlib.h>
+
+/**
+ * Scanning
+ * --------
+ *
+ * Most lines are plain ASCII, and the bytes of a plain ASCII character are
+ * printed as they are. These functions find where such runs end, using the
+ * widest vector instructions the processor has.
+ */
+
+/**
+ * Return the number of bytes at the beginning of the ``len`` bytes of
+ * ``str`` that are printable ASCII characters, that is: from 0x20 to 0x7F
+ */
+size_t ll_scan_ascii(const char *str, size_t len);
+/**
+ * Same as ``ll_scan_ascii()``, one byte at a time
+ */
+size_t ll_scan_ascii_scalar(const char *str, size_t len);
+
+#endif
@@ -0,0 +1,214 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/littleline.h"
+
+/* The heap is replaced by a pool, that fails and records it while forbidden */
+static union {
+	char bytes[1 << 20];
+	long double align;
+} pool;
+static size_t pool_used;
+static int forbidden;
+static int heap_used;
+
+/* Size of the header kept before each block of the pool */
+#define HEADER 16
+
+void *malloc(size_t size)
+{
+	char *ptr;
+
+	if (forbidden) {
+		heap_used = 1;
+		return NULL;
+	}
+	size = (size + HEADER - 1) / HEADER * HEADER;
+	if (pool_used + HEADER + size > sizeof(pool.bytes))
+		return NULL;
+	ptr = pool.bytes + pool_used;
+	pool_used += HEADER + size;
+	*(size_t *)ptr = size;
+	return ptr + HEADER;
+}
+
+void *calloc(size_t n, size_t size)
+{
+	void *ptr = malloc(n * size);
+
+	if (ptr != NULL)
+		memset(ptr, 0, n * size);
+	return ptr;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	void *moved;
+	size_t old_size;
+
+	if (ptr == NULL)
+		return malloc(size);
+	moved = malloc(size);
+	if (moved == NULL)
+		return NULL;
+	old_size = *(size_t *)((char *)ptr - HEADER);
+	memcpy(moved, ptr, old_size < size ? old_size : size);
+	return moved;
+}
+
+void free(void *ptr)
+{
+	if (forbidden && ptr != NULL)
+		heap_used = 1;
+}
+
+/* Number of lines for the history test, and length of each one */
+#define LINES 100
+#define LINE_LEN 1000
+
+static void test_arena(void)
+{
+	static char block[1024];
+	struct ll_arena arena;
+	const struct ll_allocator *alloc = &arena.alloc;
+	char *a;
+	char *b;
+	char *c;
+
+	ll_arena_init(&arena, block, sizeof(block));
+	a = alloc->malloc(alloc->user, 100);
+	b = alloc->malloc(alloc->user, 100);
+	c = alloc->malloc(alloc->user, 100);
+	if (a == NULL || b == NULL || c == NULL || a == b || b == c)
+		exit(EXIT_FAILURE);
+	memset(a, 'a', 100);
+	/* Blocks grow in place when there is room after them */
+	alloc->free(alloc->user, b, 100);
+	if (alloc->realloc(alloc->user, a, 100, 200) != a)
+		exit(EXIT_FAILURE);
+	/* Or else they move, keeping their contents */
+	b = alloc->realloc(alloc->user, a, 200, 400);
+	if (b == NULL || b == a || b[0] != 'a' || b[99] != 'a')
+		exit(EXIT_FAILURE);
+	a = c;
+	/* There is only so much memory */
+	if (alloc->malloc(alloc->user, sizeof(block)) != NULL)
+		exit(EXIT_FAILURE);
+	/* All of it can be used again once it is free */
+	alloc->free(alloc->user, a, 100);
+	alloc->free(alloc->user, b, 400);
+	a = alloc->malloc(alloc->user, sizeof(block) - LL_ARENA_UNIT);
+	if (a == NULL)
+		exit(EXIT_FAILURE);
+	alloc->free(alloc->user, a, sizeof(block) - LL_ARENA_UNIT);
+}
+
+static void put(int fd, const char *str)
+{
+	if (write(fd, str, strlen(str)) != strlen(str))
+		exit(EXIT_FAILURE);
+}
+
+static void expect_prefix(struct ll_context *ctx, const char *expected,
+		size_t min_len)
+{
+	const char *line;
+
+	line = ll_read_ctx(ctx, ">>");
+	if (line == NULL || strlen(line) < min_len
+			|| strncmp(line, expected, strlen(line)) != 0) {
+		fprintf(stderr, "Expected \"%.20s...\", got \"%.20s...\"\n",
+				expected, line ? line : "(null)");
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void test_fixed(void)
+{
+	static char block[1 << 17];
+	static char long_line[100000 + 1];
+	char line[LINE_LEN + 1];
+	struct ll_context *ctx;
+	const char *oldest;
+	int keys;
+	int out;
+	int i;
+
+	if (ll_context_new_fixed(block, 64) != NULL)
+		exit(EXIT_FAILURE);
+	ctx = ll_context_new_fixed(block, sizeof(block));
+	if (ctx == NULL)
+		exit(EXIT_FAILURE);
+
+	/* A line too long for the block, many lines that do not fit in the
+	 * history, and then a line going back as far as the history goes */
+	keys = open("alloc.keys", O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (keys < 0)
+		exit(EXIT_FAILURE);
+	unlink("alloc.keys");
+	memset(long_line, 'a', sizeof(long_line) - 1);
+	put(keys, long_line);
+	put(keys, "\n");
+	memset(line, 'x', LINE_LEN);
+	line[LINE_LEN] = 0;
+	for (i = 0; i < LINES; ++i) {
+		sprintf(line, "%03d", i);
+		line[3] = 'x';
+		put(keys, line);
+		put(keys, "\n");
+	}
+	for (i = 0; i < LINES; ++i)
+		put(keys, "\x10");
+	put(keys, "\n");
+	lseek(keys, 0, SEEK_SET);
+	out = open("/dev/null", O_WRONLY);
+	ll_set_terminal_ctx(ctx, keys, out);
+	if (ll_set_key_bindings_ctx(ctx, LL_ANSI_KEY_BINDINGS) != 0)
+		exit(EXIT_FAILURE);
+	ll_set_history_ctx(ctx, LINES);
+
+	forbidden = 1;
+	/* What does not fit is left out */
+	expect_prefix(ctx, long_line, 1000);
+	for (i = 0; i < LINES; ++i) {
+		sprintf(line, "%03d", i);
+		line[3] = 'x';
+		expect_prefix(ctx, line, LINE_LEN);
+	}
+	/* The oldest lines made room for the newest ones */
+	oldest = ll_read_ctx(ctx, ">>");
+	i = atoi(oldest);
+	sprintf(line, "%03d", i);
+	line[3] = 'x';
+	if (i == 0 || i >= LINES - 1 || strcmp(oldest, line) != 0)
+		exit(EXIT_FAILURE);
+	forbidden = 0;
+	if (heap_used)
+		exit(EXIT_FAILURE);
+
+	ll_context_delete(ctx);
+	close(out);
+	close(keys);
+}
+
+static void test_default(void)
+{
+	/* Without memory for the default context, its functions fail */
+	forbidden = 1;
+	if (ll_set_history(10) != -1 || ll_read(">>") != NULL)
+		exit(EXIT_FAILURE);
+	forbidden = 0;
+	heap_used = 0;
+}
+
+int main(int argc, char *argv[])
+{
+#if LL_MEMORY_SIZE == 0
+	test_default();
+#endif
+	test_arena();
+	test_fixed();
+	exit(EXIT_SUCCESS);
+}
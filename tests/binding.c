@@ -4,12 +4,12 @@
 
 #include "../src/binding.h"
 
-int six_zeroes(void)
+int six_zeroes(struct ll_context *ctx)
 {
 	return 0;
 }
 
-int four_ones(void)
+int four_ones(struct ll_context *ctx)
 {
 	return 0;
 }
@@ -25,7 +25,7 @@ int main(int argc, char *argv[])
 	struct ll_fsm fsm;
 	const char *str;
 	int retval;
-	int (*func)(void);
+	int (*func)(struct ll_context *);
 
 	ll_fsm_init(&fsm, paths);
 
@@ -57,5 +57,7 @@ int main(int argc, char *argv[])
 	if (retval != LL_FSM_BAD_STATE)
 		exit(EXIT_FAILURE);
 
+	ll_fsm_deinit(&fsm);
+
 	exit(EXIT_SUCCESS);
 }
@@ -2,12 +2,41 @@
 
 #include "../src/buffer.h"
 
+/* Calls made to the counting allocator, and bytes in use */
+static size_t reallocs;
+static size_t in_use;
+
+static void *counting_malloc(void *user, size_t size)
+{
+	in_use += size;
+	return malloc(size);
+}
+
+static void *counting_realloc(void *user, void *ptr, size_t old_size,
+		size_t size)
+{
+	++reallocs;
+	in_use += size - old_size;
+	return realloc(ptr, size);
+}
+
+static void counting_free(void *user, void *ptr, size_t size)
+{
+	in_use -= size;
+	free(ptr);
+}
+
+static const struct ll_allocator counting = {
+	counting_malloc, counting_realloc, counting_free, NULL
+};
+
 int main (int argc, char *argv[])
 {
 	struct ll_buf buf;
 	const char *s1;
 	const char *s2;
 	const char *s3;
+	size_t i;
 
 	ll_buf_init(&buf);
 
@@ -39,6 +68,19 @@ int main (int argc, char *argv[])
 	ll_buf_prepend(&buf, s2, strlen(s2));
 	if (buf.len != strlen(s3) || strcmp(buf.str, s3) != 0)
 		exit(EXIT_FAILURE);
+	ll_buf_deinit(&buf);
+
+	/* Growing one character at a time takes few reallocations */
+	ll_buf_init_alloc(&buf, &counting);
+	for (i = 0; i < 100000; ++i)
+		ll_buf_append_char(&buf, 'a' + i % 26);
+	if (buf.len != 100000 || buf.str[99999] != 'a' + 99999 % 26)
+		exit(EXIT_FAILURE);
+	if (reallocs > 32 || in_use != buf.allocated)
+		exit(EXIT_FAILURE);
+	ll_buf_deinit(&buf);
+	if (in_use != 0)
+		exit(EXIT_FAILURE);
 
 	exit(EXIT_SUCCESS);
 }
@@ -0,0 +1,215 @@
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "../src/display.h"
+
+struct step {
+	/* Prompt to render */
+	const char *prompt;
+	/* Line to render */
+	const char *line;
+	/* Where the cursor is */
+	size_t cursor;
+	/* Bytes expected in the frame */
+	const char *frame;
+	/* Part of the line marked, and whether it is dimmed */
+	size_t mark_begin;
+	size_t mark_end;
+	int mark_dim;
+};
+
+static const struct step steps[] = {
+	{ "", "hello", 5, "hello" },
+	{ "", "hello!", 6, "!" },
+	{ "", "hello!", 6, "" },
+	{ "", "hellx", 5, "\x1B[2Dx\x1B[K" },
+	{ "", "hex", 1, "\x1B[3Dx\x1B[K\x1B[2D" },
+	{ "", "h\x01x", 3, "^Ax" },
+	{ "", "h\x01x", 3, "" },
+	{ NULL }
+};
+
+static const struct step wrapped[] = {
+	{ "> ", "abcdefgh", 8, "> abcdefgh\r\n" },
+	{ "> ", "abcdefghi", 9, "i" },
+	{ "> ", "abcdefghi", 0, "\x1B[1A\x1B[1C" },
+	{ "> ", "ab", 2, "\x1B[2C\x1B[J" },
+	{ "> ", "abcdefgh\x01", 9, "cdefgh^A" },
+	{ "> ", "abcdefgh", 8, "\r\x1B[K" },
+	{ "$ ", "abcdefgh", 8, "\x1B[1A$ abcdefgh\r\n" },
+	{ NULL }
+};
+
+/* A shorter line ending where the mark and a row both end, as when searching
+ * goes back to a match that is a prefix of the one shown */
+static const struct step wrapped_marked[] = {
+	{ "> ", "abcdefghij", 10, "> abcdef\x1B[7mgh\x1B[27mij", 6, 8 },
+	{ "> ", "abcdefgh", 8, "\r\x1B[27m\x1B[K", 6, 8 },
+	{ NULL }
+};
+
+static const struct step wide[] = {
+	{ "", "abcdefghi\xE4\xB8\xAD", 12, "abcdefghi \xE4\xB8\xAD" },
+	{ "", "abcdefghi\xE4\xB8\xAD", 9, "\x1B[1A\x1B[7C" },
+	{ "", "abcdefghi\xE4\xB8\xAD" "e\xCC\x81", 12, "\x1B[1B\x1B[7De\xCC\x81\b" },
+	{ "", "abcdefghi\xE4\xB8\xAD" "e\xCC\x81!", 16, "\x1B[1C!" },
+	/* Control characters are not moved to the next row, but wide ones
+	 * are, clearing what was left where they would have started */
+	{ "", "abcdefghi\x01xy", 9,
+		"\x1B[1A\x1B[5C^Axy\x1B[K\x1B[1A\x1B[6C" },
+	{ "", "abcdefghi\xE4\xB8\xAD", 12, " \xE4\xB8\xAD\x1B[K" },
+	{ NULL }
+};
+
+static const struct step scrolled[] = {
+	{ "> ", "abcdefghijkl", 12, "> <hijkl" },
+	{ "> ", "abcdefghijkl", 0, "\x1B[6Dabcdef>\x1B[7D" },
+	{ "> ", "abcdefghijkl", 5, "\x1B[5C" },
+	{ NULL }
+};
+
+static const struct step marked[] = {
+	{ "> ", "hello", 5, "> h\x1B[7mel\x1B[27mlo", 1, 3 },
+	{ "> ", "hello", 1, "\x1B[4De\x1B[7mll\x1B[27mo\x1B[4D", 2, 4 },
+	{ "> ", "hello!", 6, "\x1B[1Cllo!" },
+	{ "> ", "hello!", 6, "\x1B[2D\x1B[7mo!\x1B[27m", 4, 6 },
+	{ "> ", "hello!?", 7, "\x1B[7m?\x1B[27m", 4, 7 },
+	{ NULL }
+};
+
+/* Typing over text suggested after the cursor only reprints what changed */
+static const struct step dimmed[] = {
+	{ "> ", "git status", 1, "> g\x1B[2mit status\x1B[22m\x1B[9D", 1, 10, 1 },
+	{ "> ", "git status", 2, "i", 2, 10, 1 },
+	{ "> ", "git status", 1, "\b\x1B[2mi\x1B[22m\b", 1, 10, 1 },
+	{ "> ", "go", 2, "\x1B[2mo\x1B[22m\x1B[K", 1, 2, 1 },
+	{ "> ", "go", 2, "\b\x1B[7mo\x1B[27m", 1, 2, 0 },
+	{ NULL }
+};
+
+static const struct step moves[] = {
+	{ "", "h\x01x", 0, "\r" },
+	{ "", "h\x01x", 2, "\x1B[3C" },
+	{ "", "h\x01x", 1, "\x1B[2D" },
+	{ "", "h\x01x", 3, "\x1B[3C" },
+	{ "", "h\x01x", 2, "\b" },
+	{ NULL }
+};
+
+static void render(struct ll_display *disp, const struct step *steps,
+		const char *name)
+{
+	size_t len;
+	size_t at;
+	int i;
+
+	for (i = 0; steps[i].line; ++i) {
+		/* Every other line comes in two pieces split at the cursor, as
+		 * from a gap buffer */
+		len = strlen(steps[i].line);
+		at = i % 2 ? steps[i].cursor : len;
+		disp->mark_begin = steps[i].mark_begin;
+		disp->mark_end = steps[i].mark_end;
+		disp->mark_dim = steps[i].mark_dim;
+		ll_display_render_split(disp, steps[i].prompt, steps[i].line, at,
+				steps[i].line + at, len - at, steps[i].cursor);
+		if (disp->frame.len != strlen(steps[i].frame)
+				|| memcmp(disp->frame.str, steps[i].frame, disp->frame.len) != 0) {
+			fprintf(stderr, "On %s #%d: expected \"%s\", got \"%.*s\"\n",
+					name, i + 1, steps[i].frame, (int)disp->frame.len,
+					disp->frame.str);
+			exit(EXIT_FAILURE);
+		}
+		ll_display_flush(disp);
+		if (disp->stats.last_syscalls > 1)
+			exit(EXIT_FAILURE);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	struct ll_display disp;
+	char fill[4096];
+	int fds[2];
+	int i;
+
+	ll_display_init(&disp, open("/dev/null", O_WRONLY));
+	render(&disp, steps, "step");
+	for (i = 0; moves[i].line; ++i) {
+		ll_display_move(&disp, moves[i].cursor);
+		if (disp.frame.len != strlen(moves[i].frame)
+				|| memcmp(disp.frame.str, moves[i].frame, disp.frame.len) != 0) {
+			fprintf(stderr, "On move #%d: expected \"%s\", got \"%.*s\"\n",
+					i + 1, moves[i].frame, (int)disp.frame.len,
+					disp.frame.str);
+			exit(EXIT_FAILURE);
+		}
+		ll_display_flush(&disp);
+	}
+	ll_display_finish(&disp);
+	ll_display_flush(&disp);
+	render(&disp, marked, "marked step");
+	ll_display_finish(&disp);
+	ll_display_flush(&disp);
+	render(&disp, dimmed, "dimmed step");
+	ll_display_finish(&disp);
+	ll_display_flush(&disp);
+
+	disp.cols = 10;
+	render(&disp, wrapped, "wrapped step");
+	ll_display_finish(&disp);
+	if (disp.frame.len != 0)
+		exit(EXIT_FAILURE);
+	render(&disp, wrapped_marked, "wrapped marked step");
+	ll_display_finish(&disp);
+	ll_display_flush(&disp);
+	render(&disp, wide, "wide step");
+	ll_display_finish(&disp);
+	ll_display_flush(&disp);
+
+	disp.hscroll = 1;
+	render(&disp, scrolled, "scrolled step");
+	if (ll_display_move(&disp, 3) != 0 || strcmp(disp.frame.str, "\x1B[2D") != 0)
+		exit(EXIT_FAILURE);
+	ll_display_flush(&disp);
+	if (ll_display_move(&disp, 6) == 0 || disp.frame.len != 0)
+		exit(EXIT_FAILURE);
+	ll_display_finish(&disp);
+	ll_display_flush(&disp);
+	/* The pieces are looked at as they are, even if a character is split */
+	ll_display_render_split(&disp, "> ", "ab\xE4", 3,
+			"\xB8\xAD" "cdefgh", 8, 0);
+	if (strcmp(disp.frame.str, "> ab\xE4\xB8\xAD" "cd>\x1B[7D") != 0)
+		exit(EXIT_FAILURE);
+	close(disp.fd);
+	ll_display_deinit(&disp);
+
+	/* What a full terminal can't take is kept, and sent first next time */
+	if (pipe(fds) != 0)
+		exit(EXIT_FAILURE);
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	fcntl(fds[1], F_SETFL, O_NONBLOCK);
+	memset(fill, 'x', sizeof(fill));
+	while (write(fds[1], fill, sizeof(fill)) > 0)
+		continue;
+	while (write(fds[1], fill, 1) > 0)
+		continue;
+	ll_display_init(&disp, fds[1]);
+	ll_display_render(&disp, "> ", "hello", 5, 5);
+	if (ll_display_flush(&disp) != 1 || disp.frame.len != 7)
+		exit(EXIT_FAILURE);
+	while (read(fds[0], fill, sizeof(fill)) > 0)
+		continue;
+	ll_display_put(&disp, "!", 1);
+	if (ll_display_flush(&disp) != 0 || disp.frame.len != 0
+			|| read(fds[0], fill, sizeof(fill)) != 8
+			|| memcmp(fill, "> hello!", 8) != 0)
+		exit(EXIT_FAILURE);
+	close(fds[0]);
+	close(fds[1]);
+	ll_display_deinit(&disp);
+
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,65 @@
+#include <stdio.h>
+
+#include "../src/gap.h"
+
+static void check(struct ll_gap *gap, const char *expected)
+{
+	size_t len = strlen(expected);
+	size_t i;
+
+	if (ll_gap_len(gap) != len)
+		exit(EXIT_FAILURE);
+	for (i = 0; i <= len; ++i)
+		if (ll_gap_at(gap, i) != expected[i])
+			exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+	struct ll_gap gap;
+	const char *s1;
+	size_t i;
+
+	ll_gap_init(&gap);
+	check(&gap, "");
+	if (strcmp(ll_gap_str(&gap), "") != 0)
+		exit(EXIT_FAILURE);
+
+	ll_gap_assign(&gap, "foobar", 6);
+	check(&gap, "foobar");
+
+	/* Edits in the middle keep the gap there */
+	ll_gap_insert(&gap, 3, "--", 2);
+	check(&gap, "foo--bar");
+	if (gap.begin != 5)
+		exit(EXIT_FAILURE);
+	ll_gap_insert_char(&gap, 5, '>');
+	ll_gap_erase(&gap, 3, 2);
+	check(&gap, "foo>bar");
+	if (gap.begin != 3)
+		exit(EXIT_FAILURE);
+
+	/* Spans across the gap are made contiguous */
+	if (strncmp(ll_gap_span(&gap, 2, 3), "o>b", 3) != 0)
+		exit(EXIT_FAILURE);
+	if (strncmp(ll_gap_span(&gap, 0, 2), "fo", 2) != 0)
+		exit(EXIT_FAILURE);
+	if (strncmp(ll_gap_span(&gap, 5, 2), "ar", 2) != 0)
+		exit(EXIT_FAILURE);
+	if (strcmp(ll_gap_str(&gap), "foo>bar") != 0)
+		exit(EXIT_FAILURE);
+
+	/* Growing keeps the text at both sides of the gap */
+	s1 = "string bigger than the buffer bucket size, that is 64 bytes by default";
+	ll_gap_assign(&gap, "[]", 2);
+	for (i = 0; s1[i]; ++i)
+		ll_gap_insert_char(&gap, i + 1, s1[i]);
+	if (strncmp(ll_gap_str(&gap) + 1, s1, strlen(s1)) != 0)
+		exit(EXIT_FAILURE);
+	if (gap.str[0] != '[' || strcmp(gap.str + strlen(s1) + 1, "]") != 0)
+		exit(EXIT_FAILURE);
+
+	ll_gap_deinit(&gap);
+
+	exit(EXIT_SUCCESS);
+}
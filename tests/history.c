@@ -1,5 +1,6 @@
 
 #include <stdio.h>
+#include <unistd.h>
 
 #include "../src/history.h"
 
@@ -11,9 +12,189 @@ static const char *strings2[] = {
 	"this", "is", "a", "test", "for", "overflow", NULL
 };
 
+/* File to write the history to */
+#define FILE_NAME "history.log"
+
+/* Return the number of lines in the file at path */
+static int count_lines(const char *path)
+{
+	FILE *f;
+	int c;
+	int n = 0;
+
+	f = fopen(path, "r");
+	if (f == NULL)
+		exit(EXIT_FAILURE);
+	while ((c = fgetc(f)) != EOF)
+		n += c == '\n';
+	fclose(f);
+	return n;
+}
+
+/* Write to str a line different for every n, and of varying length */
+static void make_line(char *str, int n)
+{
+	size_t len;
+
+	len = sprintf(str, "%d:", n);
+	memset(str + len, 'a' + n % 26, n * 37 % 200);
+	str[len + n * 37 % 200] = 0;
+}
+
+/* Check that hist holds the last count of the lines made so far */
+static void check_last(struct ll_history *hist, int pushed, int count)
+{
+	char expected[300];
+	int i;
+
+	if (hist->size != count)
+		exit(EXIT_FAILURE);
+	for (i = 0; i < count; ++i) {
+		make_line(expected, pushed - count + i);
+		if (strcmp(ll_history_index(hist, i), expected) != 0
+				|| ll_history_len(hist, i) != strlen(expected)) {
+			fprintf(stderr, "Expected \"%s\", got \"%s\"\n", expected,
+					ll_history_index(hist, i));
+			exit(EXIT_FAILURE);
+		}
+	}
+}
+
+/* Strings to search for */
+static const char *queries[] = {
+	"1", "12", "7:", "17:", "aaa", "1:bbb", "zzzz", "", NULL
+};
+
+/* Check that searching hist from every string finds the same ones as going
+ * through all of them */
+static void check_search(struct ll_history *hist)
+{
+	size_t index;
+	size_t expected;
+	size_t i;
+	int q;
+
+	for (q = 0; queries[q]; ++q) {
+		for (i = 0; i <= hist->size; ++i) {
+			for (expected = i; expected-- > 0;)
+				if (strstr(ll_history_index(hist, expected),
+							queries[q]) != NULL)
+					break;
+			index = i;
+			if (ll_history_search(hist, queries[q], &index) != 0)
+				index = (size_t)-1;
+			if (index != expected) {
+				fprintf(stderr, "Searching \"%s\" before %lu: "
+						"expected %ld, got %ld\n", queries[q],
+						(unsigned long)i, (long)expected,
+						(long)index);
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+}
+
+/* Beginnings of strings to search for, some longer than the ones indexed */
+static const char *prefixes[] = {
+	"1", "12", "12:", "2", "7:hhh", "12:mmmmmmmmmmmmmmmmmmmm",
+	"123:tttttttttttttttttttttttttttttttttttttttttttttttttttttttttttttttttttt",
+	"123:ttttttttttttttttttttttttttttttttttttttttttttttttttttttttttttttttx",
+	"", NULL
+};
+
+/* Check that searching hist for beginnings of strings from every string, in
+ * both directions, finds the same ones as going through all of them */
+static void check_search_prefix(struct ll_history *hist)
+{
+	size_t index;
+	size_t expected;
+	size_t len;
+	size_t i;
+	int q;
+
+	for (q = 0; prefixes[q]; ++q) {
+		len = strlen(prefixes[q]);
+		for (i = 0; i <= hist->size; ++i) {
+			for (expected = i; expected-- > 0;)
+				if (strncmp(ll_history_index(hist, expected),
+							prefixes[q], len) == 0)
+					break;
+			index = i;
+			if (ll_history_search_prefix(hist, prefixes[q], len,
+						&index) != 0)
+				index = (size_t)-1;
+			if (index != expected)
+				exit(EXIT_FAILURE);
+			for (expected = i + 1; expected < hist->size;
+					++expected)
+				if (strncmp(ll_history_index(hist, expected),
+							prefixes[q], len) == 0)
+					break;
+			index = i;
+			if (ll_history_search_prefix_forward(hist, prefixes[q],
+						len, &index) != 0)
+				index = hist->size;
+			if (expected > hist->size)
+				expected = hist->size;
+			if (index != expected) {
+				fprintf(stderr, "Searching \"%s\" after %lu: "
+						"expected %ld, got %ld\n", prefixes[q],
+						(unsigned long)i, (long)expected,
+						(long)index);
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+}
+
+/* Push line into the count strings of ref, which holds max of them, the way
+ * a history erasing duplicates does */
+static void ref_push(char ref[][300], int *count, int max, const char *line)
+{
+	int i;
+
+	if (*count > 0 && strcmp(ref[*count - 1], line) == 0)
+		return;
+	for (i = 0; i < *count && strcmp(ref[i], line) != 0; ++i)
+		continue;
+	if (i == *count && *count == max)
+		i = 0;
+	if (i < *count) {
+		memmove(ref[i], ref[i + 1], (*count - i - 1) * sizeof(ref[0]));
+		--*count;
+	}
+	strcpy(ref[(*count)++], line);
+}
+
+/* Check that hist holds the count strings of ref */
+static void check_ref(struct ll_history *hist, char ref[][300], int count)
+{
+	int i;
+
+	if (hist->size != count)
+		exit(EXIT_FAILURE);
+	for (i = 0; i < count; ++i) {
+		if (strcmp(ll_history_index(hist, i), ref[i]) != 0
+				|| ll_history_len(hist, i) != strlen(ref[i])) {
+			fprintf(stderr, "At %d: expected \"%s\", got \"%s\"\n",
+					i, ref[i], ll_history_index(hist, i));
+			exit(EXIT_FAILURE);
+		}
+	}
+}
+
 int main(int argc, char *argv[])
 {
+	static char block[1024];
+	static char big_block[4096];
+	static char ref[50][300];
+	struct ll_arena arena;
 	struct ll_history hist;
+	char str[300];
+	int count;
+	FILE *f;
+	int fds[2];
+	int n;
 	int i;
 	const char *line;
 
@@ -43,5 +224,203 @@ int main(int argc, char *argv[])
 	}
 	ll_history_deinit(&hist);
 
+	/* Lines of any length make room for each other as the buffer grows */
+	ll_history_init(&hist, 10);
+	for (i = 0; i < 100; ++i) {
+		make_line(str, i);
+		ll_history_push(&hist, str);
+		check_last(&hist, i + 1, i < 10 ? i + 1 : 10);
+	}
+	ll_history_clear(&hist);
+	ll_history_deinit(&hist);
+
+	/* Without memory for all of them, old lines make room for new ones */
+	ll_arena_init(&arena, block, sizeof(block));
+	ll_history_init_alloc(&hist, 10, &arena.alloc);
+	for (i = 0; i < 100; ++i) {
+		make_line(str, i);
+		ll_history_push(&hist, str);
+		if (hist.size == 0 || strcmp(ll_history_index(&hist,
+						hist.size - 1), str) != 0)
+			exit(EXIT_FAILURE);
+		check_last(&hist, i + 1, hist.size);
+	}
+	check_search(&hist);
+	check_search_prefix(&hist);
+	ll_history_deinit(&hist);
+
+	/* Searches only look at the strings that may hold what is looked for,
+	 * or that start with it, as they come and go */
+	ll_history_init(&hist, 50);
+	for (i = 0; i < 300; ++i) {
+		make_line(str, i);
+		ll_history_push(&hist, str);
+		if (i % 25 == 0) {
+			check_search(&hist);
+			check_search_prefix(&hist);
+		}
+	}
+	if (hist.trigrams.buckets == NULL || hist.prefixes.buckets == NULL)
+		exit(EXIT_FAILURE);
+	ll_history_clear(&hist);
+	check_search(&hist);
+	check_search_prefix(&hist);
+	ll_history_deinit(&hist);
+
+	/* Pushing a line again erases the older copy, and the erased lines
+	 * are skipped over until their room is taken back */
+	ll_history_init(&hist, 50);
+	ll_history_erase_dups(&hist, 1);
+	count = 0;
+	for (i = 0; i < 2000; ++i) {
+		n = i % 7 == 0 ? i : i * i % 61;
+		make_line(str, n);
+		ll_history_push(&hist, str);
+		ref_push(ref, &count, 50, str);
+		check_ref(&hist, ref, count);
+		if (i % 100 == 0) {
+			check_search(&hist);
+			check_search_prefix(&hist);
+		}
+	}
+	if (hist.strings.buckets == NULL || hist.held == NULL)
+		exit(EXIT_FAILURE);
+	ll_history_clear(&hist);
+	check_ref(&hist, ref, 0);
+	ll_history_deinit(&hist);
+
+	/* The same happens with lines there is no room for */
+	ll_arena_init(&arena, big_block, sizeof(big_block));
+	ll_history_init_alloc(&hist, 10, &arena.alloc);
+	ll_history_erase_dups(&hist, 1);
+	for (i = 0; i < 500; ++i) {
+		make_line(str, i % 4 == 0 ? i : i % 5);
+		ll_history_push(&hist, str);
+		if (hist.size == 0 || strcmp(ll_history_index(&hist,
+						hist.size - 1), str) != 0)
+			exit(EXIT_FAILURE);
+		for (n = 0; n + 1 < hist.size; ++n)
+			if (strcmp(ll_history_index(&hist, n), str) == 0)
+				exit(EXIT_FAILURE);
+	}
+	check_search(&hist);
+	check_search_prefix(&hist);
+	ll_history_deinit(&hist);
+
+	/* Lines held already lose their older copies */
+	ll_history_init(&hist, 10);
+	count = 0;
+	for (i = 0; i < 9; ++i) {
+		make_line(str, i * 5 % 4);
+		ll_history_push(&hist, str);
+		ref_push(ref, &count, 10, str);
+	}
+	if (hist.size != 9)
+		exit(EXIT_FAILURE);
+	ll_history_erase_dups(&hist, 1);
+	check_ref(&hist, ref, count);
+	ll_history_erase_dups(&hist, 0);
+	check_ref(&hist, ref, count);
+	ll_history_deinit(&hist);
+
+	/* Lines are appended to the file, which is cut down once in a while */
+	unlink(FILE_NAME);
+	ll_history_init(&hist, 10);
+	for (i = 0; i < 35; ++i) {
+		make_line(str, i);
+		ll_history_push(&hist, str);
+		if (ll_history_append(&hist, FILE_NAME) != 0)
+			exit(EXIT_FAILURE);
+		/* Twice the lines of the history are written back as many */
+		n = i < 20 ? i + 1 : 10 + (i - 20) % 11;
+		if (count_lines(FILE_NAME) != n)
+			exit(EXIT_FAILURE);
+	}
+	ll_history_deinit(&hist);
+	ll_history_init(&hist, 10);
+	if (ll_history_read(&hist, FILE_NAME) != 0)
+		exit(EXIT_FAILURE);
+	check_last(&hist, 35, 10);
+	ll_history_deinit(&hist);
+
+	/* Only the end of a long file is read, with the same lines left out
+	 * as if all of it had been */
+	f = fopen(FILE_NAME, "w");
+	if (f == NULL)
+		exit(EXIT_FAILURE);
+	for (i = 0; i < 100; ++i) {
+		make_line(str, i);
+		fprintf(f, "%s\n%s\n \n\n", str, str);
+	}
+	fclose(f);
+	ll_history_init(&hist, 10);
+	if (ll_history_read(&hist, FILE_NAME) != 0)
+		exit(EXIT_FAILURE);
+	check_last(&hist, 100, 10);
+	/* The file has too many lines, so it is cut down on the next append */
+	make_line(str, 100);
+	ll_history_push(&hist, str);
+	if (ll_history_append(&hist, FILE_NAME) != 0
+			|| count_lines(FILE_NAME) != 10)
+		exit(EXIT_FAILURE);
+	/* A short file is read whole, and lines are still appended to it */
+	f = fopen(FILE_NAME, "w");
+	if (f == NULL)
+		exit(EXIT_FAILURE);
+	for (i = 0; i < 4; ++i) {
+		make_line(str, i);
+		fprintf(f, "%s\n%s\n", str, str);
+	}
+	fclose(f);
+	if (ll_history_read(&hist, FILE_NAME) != 0)
+		exit(EXIT_FAILURE);
+	check_last(&hist, 4, 4);
+	make_line(str, 4);
+	ll_history_push(&hist, str);
+	if (ll_history_append(&hist, FILE_NAME) != 0
+			|| count_lines(FILE_NAME) != 9)
+		exit(EXIT_FAILURE);
+	ll_history_deinit(&hist);
+
+	/* Erasing duplicates, the end of the file read holds as many different
+	 * lines as the history does */
+	f = fopen(FILE_NAME, "w");
+	if (f == NULL)
+		exit(EXIT_FAILURE);
+	count = 0;
+	for (i = 0; i < 250; ++i) {
+		if (i < 50)
+			make_line(str, i);
+		else
+			sprintf(str, "command %d", i % 5);
+		fprintf(f, "%s\n", str);
+		ref_push(ref, &count, 20, str);
+	}
+	fclose(f);
+	ll_history_init(&hist, 20);
+	ll_history_erase_dups(&hist, 1);
+	if (ll_history_read(&hist, FILE_NAME) != 0)
+		exit(EXIT_FAILURE);
+	check_ref(&hist, ref, count);
+	ll_history_deinit(&hist);
+	unlink(FILE_NAME);
+
+	/* Files that can't be mapped, such as pipes, are read whole */
+	if (pipe(fds) != 0)
+		exit(EXIT_FAILURE);
+	for (i = 0; i < 20; ++i) {
+		make_line(str, i);
+		if (write(fds[1], str, strlen(str)) < 0 || write(fds[1], "\n", 1) < 0)
+			exit(EXIT_FAILURE);
+	}
+	close(fds[1]);
+	sprintf(str, "/dev/fd/%d", fds[0]);
+	ll_history_init(&hist, 10);
+	if (ll_history_read(&hist, str) != 0)
+		exit(EXIT_FAILURE);
+	check_last(&hist, 20, 10);
+	ll_history_deinit(&hist);
+	close(fds[0]);
+
 	exit(EXIT_SUCCESS);
 }
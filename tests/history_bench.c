@@ -0,0 +1,262 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/history.h"
+
+/* File the history is loaded from */
+#define FILE_NAME "history_bench.log"
+
+/* Write a history file of lines lines, and return its size */
+static size_t make_file(size_t lines)
+{
+	FILE *f;
+	size_t size = 0;
+	size_t i;
+
+	f = fopen(FILE_NAME, "w");
+	if (f == NULL)
+		exit(EXIT_FAILURE);
+	for (i = 0; i < lines; ++i)
+		size += fprintf(f, "git commit -m 'Change number %lu' src/file%lu.c\n",
+				(unsigned long)i, (unsigned long)(i % 97));
+	fclose(f);
+	return size;
+}
+
+/* Load the file one character at a time, as a reference */
+static void read_bytes(struct ll_history *hist)
+{
+	char line[256];
+	size_t len = 0;
+	FILE *f;
+	int c;
+
+	f = fopen(FILE_NAME, "r");
+	if (f == NULL)
+		exit(EXIT_FAILURE);
+	ll_history_clear(hist);
+	while ((c = fgetc(f)) != EOF) {
+		if (c == '\n') {
+			line[len] = 0;
+			ll_history_push(hist, line);
+			len = 0;
+		} else if (len + 1 < sizeof(line)) {
+			line[len++] = c;
+		}
+	}
+	fclose(f);
+}
+
+static void read_file(struct ll_history *hist)
+{
+	if (ll_history_read(hist, FILE_NAME) != 0)
+		exit(EXIT_FAILURE);
+}
+
+/* Seconds spent by loading the file with load */
+static double time_load(void (*load)(struct ll_history *), size_t max_lines)
+{
+	struct ll_history hist;
+	clock_t start;
+	double seconds;
+
+	ll_history_init(&hist, max_lines);
+	start = clock();
+	load(&hist);
+	seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+	if (hist.size != max_lines)
+		exit(EXIT_FAILURE);
+	ll_history_deinit(&hist);
+	return seconds;
+}
+
+static void bench(size_t lines, size_t max_lines)
+{
+	size_t size = make_file(lines);
+	double bytes;
+	double file;
+
+	bytes = time_load(read_bytes, max_lines);
+	file = time_load(read_file, max_lines);
+	printf("%8lu lines, keeping %6lu: by byte %7.3f s, "
+			"ll_history_read %7.3f s (x%.1f, %.0f MB/s)\n",
+			(unsigned long)lines, (unsigned long)max_lines, bytes, file,
+			bytes / file, size / file / 1e6);
+}
+
+/* Look for str before index through every string, as a reference */
+static int search_all(struct ll_history *hist, const char *str,
+		size_t *index)
+{
+	size_t i;
+
+	for (i = *index; i-- > 0;) {
+		if (strstr(ll_history_index(hist, i), str) != NULL) {
+			*index = i;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/* Look for a string starting with str before index through every string,
+ * as a reference */
+static int search_prefix_all(struct ll_history *hist, const char *str,
+		size_t *index)
+{
+	size_t len = strlen(str);
+	size_t i;
+
+	for (i = *index; i-- > 0;) {
+		if (strncmp(ll_history_index(hist, i), str, len) == 0) {
+			*index = i;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static int search_prefix(struct ll_history *hist, const char *str,
+		size_t *index)
+{
+	return ll_history_search_prefix(hist, str, strlen(str), index);
+}
+
+/* Seconds spent by searching with search for every prefix of query, as it
+ * is typed, and then going back a few matches further with the whole of it */
+static double time_search(struct ll_history *hist,
+		int (*search)(struct ll_history *, const char *, size_t *),
+		const char *query, size_t *found)
+{
+	char typed[64];
+	clock_t start;
+	size_t index = hist->size;
+	size_t len;
+	int i;
+
+	*found = 0;
+	start = clock();
+	for (len = 1; query[len - 1]; ++len) {
+		memcpy(typed, query, len);
+		typed[len] = 0;
+		index = hist->size;
+		if (search(hist, typed, &index) == 0)
+			*found += index;
+	}
+	for (i = 0; i < 10 && search(hist, query, &index) == 0; ++i)
+		*found += index;
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static void bench_search(size_t lines, size_t max_lines, const char *query,
+		int (*all_search)(struct ll_history *, const char *, size_t *),
+		int (*search)(struct ll_history *, const char *, size_t *),
+		const char *name)
+{
+	struct ll_history hist;
+	size_t all_found;
+	size_t found;
+	double all;
+	double indexed;
+
+	make_file(lines);
+	ll_history_init(&hist, max_lines);
+	read_file(&hist);
+	all = time_search(&hist, all_search, query, &all_found);
+	indexed = time_search(&hist, search, query, &found);
+	if (found != all_found)
+		exit(EXIT_FAILURE);
+	printf("%8lu lines, searching \"%s\": through all %7.3f s, "
+			"%s %7.3f s (x%.1f)\n",
+			(unsigned long)max_lines, query, all, name, indexed,
+			all / indexed);
+	ll_history_deinit(&hist);
+}
+
+/* Print the memory taken by a history of lines lines with its indexes */
+static void bench_memory(size_t lines)
+{
+	struct ll_history hist;
+	struct ll_counter counter;
+	size_t size = make_file(lines);
+
+	ll_counter_init(&counter, &ll_heap_allocator);
+	ll_history_init_alloc(&hist, lines, &counter.alloc);
+	read_file(&hist);
+	printf("%8lu lines, %.1f MB of text: %.1f MB in use\n",
+			(unsigned long)lines, size / 1e6,
+			counter.stats.bytes / 1e6);
+	ll_history_deinit(&hist);
+}
+
+/* Seconds spent by pushing lines lines, most of them one of a few commands
+ * used over and over, with older copies erased if erase_dups is set */
+static double time_push(struct ll_history *hist, size_t lines,
+		int erase_dups)
+{
+	static const char *commands[] = {
+		"ls", "make", "git status", "git diff", "cd ..", "vi Makefile",
+		"make test", "git log", "cd src", "ls -l", "make clean", "git add ."
+	};
+	char line[64];
+	clock_t start;
+	size_t i;
+
+	ll_history_erase_dups(hist, erase_dups);
+	start = clock();
+	for (i = 0; i < lines; ++i) {
+		if (i % 10 == 0)
+			sprintf(line, "./run --case %lu", (unsigned long)i);
+		else
+			strcpy(line, commands[i * 7 % 12]);
+		ll_history_push(hist, line);
+	}
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static void bench_push(size_t lines, size_t max_lines)
+{
+	struct ll_history hist;
+	double kept;
+	double erased;
+	size_t size;
+
+	ll_history_init(&hist, max_lines);
+	kept = time_push(&hist, lines, 0);
+	ll_history_deinit(&hist);
+	ll_history_init(&hist, max_lines);
+	erased = time_push(&hist, lines, 1);
+	size = hist.size;
+	ll_history_deinit(&hist);
+	printf("%8lu lines, keeping %6lu: pushing %7.3f s, "
+			"erasing duplicates %7.3f s (%lu held)\n",
+			(unsigned long)lines, (unsigned long)max_lines, kept,
+			erased, (unsigned long)size);
+}
+
+int main(int argc, char *argv[])
+{
+	bench(100000, 1000);
+	bench(1000000, 1000);
+	bench(1000000, 100000);
+	bench_search(1000000, 1000000, "Change number 12345'", search_all,
+			ll_history_search, "ll_history_search");
+	bench_search(1000000, 1000000, "file42.c", search_all,
+			ll_history_search, "ll_history_search");
+	bench_search(1000000, 1000000, "git push", search_all,
+			ll_history_search, "ll_history_search");
+	bench_search(1000000, 1000000, "git commit -m 'Change number 12345'",
+			search_prefix_all, search_prefix,
+			"ll_history_search_prefix");
+	bench_search(1000000, 1000000, "git push", search_prefix_all,
+			search_prefix, "ll_history_search_prefix");
+	bench_memory(100000);
+	bench_push(1000000, 1000);
+	bench_push(1000000, 100000);
+	unlink(FILE_NAME);
+
+	exit(EXIT_SUCCESS);
+}
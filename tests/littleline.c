@@ -0,0 +1,259 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/littleline.h"
+
+/* Create a context reading from a pipe that already holds ``keys`` */
+static struct ll_context *session(const char *keys, int out)
+{
+	struct ll_context *ctx;
+	int fds[2];
+
+	if (pipe(fds) != 0)
+		exit(EXIT_FAILURE);
+	if (write(fds[1], keys, strlen(keys)) != strlen(keys))
+		exit(EXIT_FAILURE);
+	close(fds[1]);
+	ctx = ll_context_new();
+	ll_set_terminal_ctx(ctx, fds[0], out);
+	ll_set_key_bindings_ctx(ctx, LL_ANSI_KEY_BINDINGS);
+	ll_set_history_ctx(ctx, 10);
+	return ctx;
+}
+
+static void expect(struct ll_context *ctx, const char *expected)
+{
+	const char *line;
+
+	line = ll_read_ctx(ctx, ">>");
+	if (expected == NULL && line == NULL)
+		return;
+	if (expected == NULL || line == NULL || strcmp(line, expected) != 0) {
+		fprintf(stderr, "Expected \"%s\", got \"%s\"\n",
+				expected ? expected : "(null)", line ? line : "(null)");
+		exit(EXIT_FAILURE);
+	}
+}
+
+/* Lines accepted through the callback interface */
+static char accepted[4][64];
+static int naccepted;
+/* Whether the input fed through the callback interface ended */
+static int ended;
+
+static void on_line(struct ll_context *ctx, const char *line)
+{
+	if (line == NULL) {
+		ended = 1;
+		return;
+	}
+	strcpy(accepted[naccepted++], line);
+	if (naccepted == 3)
+		ll_end(ctx);
+}
+
+/* Bytes currently taken from the tracking allocator */
+static size_t tracked;
+
+static void *tracked_malloc(void *user, size_t size)
+{
+	tracked += size;
+	return malloc(size);
+}
+
+static void *tracked_realloc(void *user, void *ptr, size_t old_size,
+		size_t size)
+{
+	tracked += size - old_size;
+	return realloc(ptr, size);
+}
+
+static void tracked_free(void *user, void *ptr, size_t size)
+{
+	if (ptr != NULL)
+		tracked -= size;
+	free(ptr);
+}
+
+static const struct ll_allocator tracking = {
+	tracked_malloc, tracked_realloc, tracked_free, NULL
+};
+
+static void feed(struct ll_context *ctx, const char *keys)
+{
+	if (ll_feed(ctx, keys, strlen(keys)) != 0)
+		exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+	struct ll_context *first;
+	struct ll_context *second;
+	struct ll_alloc_stats stats[LL_ALLOC_KINDS];
+	char output[256];
+	size_t total;
+	ssize_t n;
+	int fds[2];
+	int out;
+	int i;
+
+	out = open("/dev/null", O_WRONLY);
+	if (out < 0)
+		exit(EXIT_FAILURE);
+
+	/* Sessions are independent, even when used alternately */
+	first = session("hello\x01" "X\n" "\x10\x05!\n", out);
+	second = session("one\ntwo\x17" "2\n\x10\x10\n", out);
+	expect(first, "Xhello");
+	expect(second, "one");
+	expect(first, "Xhello!");
+	expect(second, "2");
+	expect(second, "one");
+	expect(first, NULL);
+	expect(second, NULL);
+	ll_context_delete(first);
+	ll_context_delete(second);
+
+	/* Only a terminal is told to mark pasted text */
+	if (pipe(fds) != 0)
+		exit(EXIT_FAILURE);
+	first = session("line\n", fds[1]);
+	expect(first, "line");
+	ll_context_delete(first);
+	close(fds[1]);
+	n = read(fds[0], output, sizeof(output) - 1);
+	if (n <= 0)
+		exit(EXIT_FAILURE);
+	output[n] = 0;
+	if (strstr(output, "line") == NULL || strstr(output, "\x1B[?2004") != NULL)
+		exit(EXIT_FAILURE);
+	close(fds[0]);
+
+	/* C-c ends the input as the end of the file does */
+	first = session("one\n\x03two\n", out);
+	expect(first, "one");
+	expect(first, NULL);
+	ll_context_delete(first);
+
+	/* The history is searched as the text to look for is typed */
+	first = session("git status\nmake all\ngit commit\n"
+			"\x12git\n" "\x12git\x12\n" "abc\x12mak\x07\n"
+			"\x12makz\x7F\x7F\n" "\x12st\x1B[C!\n", out);
+	expect(first, "git status");
+	expect(first, "make all");
+	expect(first, "git commit");
+	expect(first, "git commit");
+	expect(first, "git status");
+	expect(first, "abc");
+	expect(first, "make all");
+	expect(first, "git s!tatus");
+	ll_context_delete(first);
+
+	/* Up and Down may go only through the lines starting with what is
+	 * before the cursor */
+	first = session("git status\nmake all\ngit commit\n"
+			"git\x1B[A\n" "git\x1B[A\x1B[A\n"
+			"git\x1B[A\x1B[A\x1B[B!\n" "m\x1B[A\x1B[A\n"
+			"x\x1B[A\x1B[B\n" "gi\x1B[A\x1B[B\n", out);
+	ll_set_history_search_prefix_ctx(first, 1);
+	expect(first, "git status");
+	expect(first, "make all");
+	expect(first, "git commit");
+	expect(first, "git commit");
+	expect(first, "git status");
+	expect(first, "git! status");
+	expect(first, "make all");
+	expect(first, "x");
+	expect(first, "gi");
+	ll_context_delete(first);
+
+	/* The newest line starting with the text typed is suggested after it,
+	 * and Right or End at the end of the line take it */
+	first = session("git status\nmake all\ngit commit\n"
+			"gi\x1B[C\n" "git s\x05\n" "git c\x1B[C\n"
+			"ma\x02\x1B[C\n" "mak\x02\x05\x05\n" "git x\x1B[C\n"
+			"git cx\x7F\x7Fs\x1B[C\n", out);
+	ll_set_autosuggest_ctx(first, 1);
+	expect(first, "git status");
+	expect(first, "make all");
+	expect(first, "git commit");
+	expect(first, "git commit");
+	expect(first, "git status");
+	expect(first, "git commit");
+	expect(first, "ma");
+	expect(first, "make all");
+	expect(first, "git x");
+	expect(first, "git status");
+	ll_context_delete(first);
+
+	/* Lines accepted again leave the history only once */
+	first = session("ls\nmake\nls\ncd\nmake\n"
+			"\x10\x10\x10\n" "\x10\x10\x10\x10\n", out);
+	ll_set_history_erase_dups_ctx(first, 1);
+	expect(first, "ls");
+	expect(first, "make");
+	expect(first, "ls");
+	expect(first, "cd");
+	expect(first, "make");
+	expect(first, "ls");
+	expect(first, "cd");
+	ll_context_delete(first);
+
+	/* Pasted text goes in as it is */
+	first = session("a\x1B[200~b\nc\x1B[201~d\n", out);
+	expect(first, "ab\ncd");
+	ll_context_delete(first);
+
+	/* Input may arrive in pieces, cutting key sequences in two */
+	first = ll_context_new();
+	ll_set_terminal_ctx(first, -1, out);
+	ll_set_key_bindings_ctx(first, LL_ANSI_KEY_BINDINGS);
+	ll_set_history_ctx(first, 10);
+	ll_begin(first, ">>", on_line);
+	feed(first, "ac\x1B[");
+	feed(first, "D");
+	feed(first, "b\x1B");
+	feed(first, "[200~x\ny\x1B[20");
+	feed(first, "1~\nsecond\n\x1B");
+	if (naccepted != 2 || strcmp(accepted[0], "abx\nyc") != 0
+			|| strcmp(accepted[1], "second") != 0)
+		exit(EXIT_FAILURE);
+	/* A lone Escape is only known to be such when nothing else comes */
+	ll_feed(first, NULL, 0);
+	feed(first, "\x16\x01!\n");
+	if (naccepted != 3 || strcmp(accepted[2], "\x1B\x01!") != 0)
+		exit(EXIT_FAILURE);
+	if (ll_feed(first, "more\n", 5) != -1 || naccepted != 3)
+		exit(EXIT_FAILURE);
+	/* C-d on an empty line ends the input instead of the process */
+	ll_begin(first, ">>", on_line);
+	feed(first, "x\x01\x04\x04\x04ignored");
+	if (!ended || naccepted != 3 || ll_feed(first, "\n", 1) != -1)
+		exit(EXIT_FAILURE);
+	ll_context_delete(first);
+
+	/* All memory comes from the allocator, accounted to each part */
+	ll_set_allocator(&tracking);
+	first = session("some line\n", out);
+	ll_set_history_with_file_ctx(first, 20, "/dev/null");
+	expect(first, "some line");
+	ll_get_alloc_stats_ctx(first, stats);
+	total = 0;
+	for (i = 0; i < LL_ALLOC_KINDS; ++i) {
+		if (stats[i].bytes == 0 || stats[i].blocks == 0)
+			exit(EXIT_FAILURE);
+		total += stats[i].bytes;
+	}
+	if (total != tracked)
+		exit(EXIT_FAILURE);
+	ll_context_delete(first);
+	ll_set_allocator(NULL);
+	if (tracked != 0)
+		exit(EXIT_FAILURE);
+
+	close(out);
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,42 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../src/scan.h"
+
+int main(int argc, char *argv[])
+{
+	char str[256];
+	size_t len;
+	size_t i;
+	size_t j;
+
+	for (i = 0; i < sizeof(str); ++i)
+		str[i] = 'a' + i % 26;
+
+	/* A stopper at every place, for every alignment and length */
+	for (i = 0; i < 64; ++i) {
+		for (len = 0; len + i <= 160; ++len) {
+			for (j = i; j <= i + len && j < sizeof(str); ++j) {
+				str[j] = "\n\x80\xFF\x1F"[j % 4];
+				if (ll_scan_ascii(str + i, len)
+						!= ll_scan_ascii_scalar(str + i, len)) {
+					fprintf(stderr, "Mismatch at offset %lu, length %lu, "
+							"stopper at %lu\n", (unsigned long)i,
+							(unsigned long)len, (unsigned long)j);
+					exit(EXIT_FAILURE);
+				}
+				str[j] = 'a' + j % 26;
+			}
+		}
+	}
+
+	if (ll_scan_ascii("hello, world\x7F", 13) != 13)
+		exit(EXIT_FAILURE);
+	if (ll_scan_ascii("hello,\tworld", 12) != 6)
+		exit(EXIT_FAILURE);
+	if (ll_scan_ascii("caf\xC3\xA9", 5) != 3)
+		exit(EXIT_FAILURE);
+
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,74 @@
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/display.h"
+#include "../src/scan.h"
+
+/* Seconds spent by calling scan on str round times */
+static double time_scan(size_t (*scan)(const char *, size_t), const char *str,
+		size_t len, int rounds)
+{
+	clock_t start = clock();
+	size_t total = 0;
+	int i;
+
+	for (i = 0; i < rounds; ++i)
+		total += scan(str, len);
+	if (total != len * rounds)
+		exit(EXIT_FAILURE);
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* Seconds spent by rendering str from scratch round times */
+static double time_render(struct ll_display *disp, const char *str,
+		size_t len, int rounds)
+{
+	clock_t start = clock();
+	int i;
+
+	for (i = 0; i < rounds; ++i) {
+		ll_display_reset(disp);
+		ll_display_render(disp, "> ", str, len, len);
+		ll_buf_truncate(&disp->frame, 0);
+	}
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static void bench(struct ll_display *disp, size_t len, int rounds)
+{
+	char *str = malloc(len + 1);
+	double scalar;
+	double vector;
+	double render;
+	size_t i;
+
+	for (i = 0; i < len; ++i)
+		str[i] = ' ' + i % 95;
+	str[len] = 0;
+	scalar = time_scan(ll_scan_ascii_scalar, str, len, rounds);
+	vector = time_scan(ll_scan_ascii, str, len, rounds);
+	render = time_render(disp, str, len, rounds / 16 + 1);
+	printf("%8lu bytes: scalar %7.3f GB/s, vector %7.3f GB/s (x%.1f), "
+			"render %7.3f GB/s\n", (unsigned long)len,
+			len * (double)rounds / scalar / 1e9,
+			len * (double)rounds / vector / 1e9, scalar / vector,
+			len * (double)(rounds / 16 + 1) / render / 1e9);
+	free(str);
+}
+
+int main(int argc, char *argv[])
+{
+	struct ll_display disp;
+
+	ll_display_init(&disp, open("/dev/null", O_WRONLY));
+	bench(&disp, 4096, 200000);
+	bench(&disp, 1 << 20, 800);
+	close(disp.fd);
+	ll_display_deinit(&disp);
+
+	exit(EXIT_SUCCESS);
+}